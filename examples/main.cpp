@@ -23,6 +23,14 @@ void setup(){
         vTaskDelay(800);
     }
     Serial.println("WiFi connected\n");
+    dlna.enableNotifyListener(); // optional, track servers that come and go (ssdp:alive, ssdp:byebye)
+//  if(dlna.loadServerCache() > 0) f_browse = true; // optional, servers of the last session are usable at once
+//  dlna.setMemoryLimit(32768); // optional, boards without PSRAM: large containers are reported item by item, getMemoryPeak() shows the need
+//  dlna.setListener(&myListener, 20); // optional, a DLNA_Client::Listener per instance instead of the dlna_xxx() functions, items in batches of 20
+//  dlna.startTask(2, 8192, 0); // optional, the client runs in its own task on core 0: requestBrowse() ... and getResult() instead of browseServer() and loop()
+//  dlna.setLoopBudget(1000); // optional, loop() returns after 1ms also while a large Browse comes in, getLoopMax() shows the longest call
+//  dlna.enableBrowseCache(); // optional, repeated Browse requests are answered from memory while the server content is unchanged
+//  LittleFS.begin(true); dlna.openIndex(); // optional, search the title index of an earlier dlna.startCrawl(0) without network traffic
     f_seek = true;
 }
 
@@ -36,22 +44,24 @@ void loop(){
 
     if(f_browse){
         dlna.browseServer(0, "0"); // objectId "0" is root
+    //  dlna.browseServerAll(0, "0"); // alternatively all children, page by page, items arrive in dlna_browseResult()
+    //  dlna.searchServer(0, "0", "dc:title contains \"love\""); // or search, returns -4 if the server can't search for it
         f_browse = false;
     }
 }
 // --------------------------------------------------------------------------------------------------
 void getserver(){  // example: read server items
-    DLNA_Client::dlnaServer_t srv = dlna.getServer();
-    for(int i = 0; i< srv.size; i++){
-        Serial.printf("[%i] %s\n", i, srv.controlURL[i]);
+    for(int i = 0; i < dlna.getNrOfServers(); i++){
+        DLNA_Client::serverInfo_t srv = dlna.getServerInfo(i); // no copy, the strings belong to the client
+        Serial.printf("[%i] %s\n", i, srv.controlURL);
     }
     Serial.println();
 }
 
 void getBrowseContent(){ // example: read some content after browsing
-    DLNA_Client::srvContent srvCt = dlna.getBrowseResult();
-    for(int i = 0; i< srvCt.size; i++){
-        Serial.printf("[%i] %s\n", i, srvCt.title[i]);
+    int i = 0;
+    for(DLNA_Client::contentItem_t item : dlna.browseItems()){ // no copy, valid until the next browse
+        Serial.printf("[%i] %s\n", i++, item.title);
     }
     Serial.println();
 }
@@ -65,6 +75,10 @@ void dlna_server(uint8_t serverId, const char* IP_addr, uint16_t port, const cha
     Serial.printf("id %i, name: %s, IP %s:%i\n", serverId, friendlyName, IP_addr, port);
 }
 
+void dlna_serverLost(uint8_t serverId, const char* IP_addr, uint16_t port, const char* friendlyName){
+    Serial.printf("id %i, name: %s, IP %s:%i has gone\n", serverId, friendlyName, IP_addr, port);
+}
+
 void dlna_seekReady(uint8_t numberOfServer){
     Serial.printf("%i media servers found\n\n", numberOfServer);
     f_browse = true;
@@ -78,6 +92,8 @@ void dlna_browseResult(const char* objectId, const char* parentId, uint16_t chil
 void dlna_browseReady(uint16_t numbertReturned, uint16_t totalMatches){
     Serial.printf("returned %i from %i\n", numbertReturned, totalMatches);
     Serial.printf("\n%s\n\n", dlna.stringifyContent()); // and now stringify the browse result, make JSONstring:
+//  dlna.printContent(Serial); // or write the JSON to any Print (Serial, File, WiFiClient) without building the string
+//  size_t n = dlna.cborContent(buf, sizeof(buf)); // compact binary form (CBOR), n > sizeof(buf): buffer too small
     getserver();
     getBrowseContent();
 }
@@ -0,0 +1,201 @@
+// host benchmarks of the DLNA client, see README.md
+#define private public // entity: the tokenizer is fed directly, without the network
+#include "DLNAClient.h"
+#undef private
+#include <string>
+#include <vector>
+
+DLNA_Client dlna;
+
+static uint32_t usNow(clockid_t clk = CLOCK_MONOTONIC){
+    struct timespec ts; clock_gettime(clk, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+static void idle(){ // loop() until the client is idle
+    do{ dlna.loop(); usleep(100); } while(dlna.getState() != DLNA_Client::IDLE);
+}
+static bool seek(uint16_t port){ // the fake server answers the M-SEARCH through the mocked UDP
+    char b[400];
+    sprintf(b, "HTTP/1.1 200 OK\r\nCACHE-CONTROL: max-age=1800\r\nST: urn:schemas-upnp-org:device:MediaServer:1\r\n"
+               "USN: uuid:4d696e69-444c-164e-9d41-%d::urn:schemas-upnp-org:device:MediaServer:1\r\n"
+               "Location: http://127.0.0.1:%d/rootDesc.xml\r\nContent-Length: 0\r\n\r\n", port, port);
+    WiFiUDP::rxq.push_back({b, {IPAddress(127, 0, 0, 1), 0}});
+    dlna.seekServer(1, 1);
+    idle();
+    return dlna.getNrOfServers() == 1;
+}
+//------------------------------------------------------------------------------------------------------------------------------
+static uint32_t rawRead(uint16_t port, uint16_t items, uint16_t block, uint32_t& bytes){ // one Browse response, read in blocks of `block` bytes
+    static const char body[] = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body>"
+                               "<u:Browse xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\"><ObjectID>0</ObjectID>"
+                               "<BrowseFlag>BrowseDirectChildren</BrowseFlag><Filter>*</Filter><StartingIndex>0</StartingIndex>"
+                               "<RequestedCount>%u</RequestedCount><SortCriteria></SortCriteria></u:Browse></s:Body></s:Envelope>";
+    char soap[512], req[768];
+    int len = snprintf(soap, sizeof(soap), body, items);
+    snprintf(req, sizeof(req), "POST /ctl/ContentDir HTTP/1.1\r\nHost: 127.0.0.1:%u\r\nConnection: close\r\nContent-Length: %d\r\n"
+                               "SOAPAction: \"urn:schemas-upnp-org:service:ContentDirectory:1#Browse\"\r\n\r\n%s", port, len, soap);
+    WiFiClient c;
+    if(!c.connect("127.0.0.1", port)) return 0;
+    c.print(req);
+    while(!c.available() && c.connected()) usleep(100); // the server builds the response, not measured
+    uint8_t buf[4096];
+    bytes = 0;
+    uint32_t t = usNow();
+    while(c.connected()){
+        int n = (block == 1) ? c.read() : c.read(buf, block);
+        if(n < 0) continue;
+        bytes += (block == 1) ? 1 : n;
+    }
+    return usNow() - t;
+}
+//------------------------------------------------------------------------------------------------------------------------------
+static int rx(uint16_t port){ // a large Browse response: raw reads in small and large blocks, then the whole browseServer() path
+    uint16_t items = getenv("ITEMS") ? atoi(getenv("ITEMS")) : 1000;
+    uint32_t bytes = 0;
+    for(uint16_t block : {1, 256, 4096}){
+        uint32_t best = UINT32_MAX;
+        for(int k = 0; k < 5; k++){ uint32_t us = rawRead(port, items, block, bytes); if(us && us < best) best = us; }
+        printf("raw read(), %4u byte blocks: %u bytes in %6.2f ms\n", block, bytes, best / 1000.0);
+    }
+    if(!seek(port)) {printf("no server\n"); return 1;}
+    uint32_t best = UINT32_MAX;
+    for(int k = 0; k < 5; k++){
+        uint32_t t = usNow();
+        dlna.browseServer(0, "0", 0, items);
+        idle();
+        t = usNow() - t;
+        if(t < best) best = t;
+    }
+    printf("browseServer(), %u items parsed and stored: %6.2f ms\n", dlna.getItemCount(), best / 1000.0);
+    return 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------
+static int replacestr(char* line, const char* search, const char* replace){ // the earlier in-place entity decoding, verbatim
+    char* sp;
+    if((sp = strstr(line, search)) == NULL) return 0;
+    int count = 1;
+    int sLen = strlen(search);
+    int rLen = strlen(replace);
+    if(sLen > rLen){
+        char* src = sp + sLen;
+        char* dst = sp + rLen;
+        while((*dst = *src) != '\0') {dst++; src++;}
+    }
+    else if(sLen < rLen){
+        int tLen = strlen(sp) - sLen;
+        char* stop = sp + rLen;
+        char* src = sp + sLen + tLen;
+        char* dst = sp + rLen + tLen;
+        while(dst >= stop) {*dst = *src; dst--; src--;}
+    }
+    memcpy(sp, replace, rLen);
+    count += replacestr(sp + rLen, search, replace);
+    return count;
+}
+//------------------------------------------------------------------------------------------------------------------------------
+static std::string escape(const std::string& s){ // as the server puts DIDL-Lite into <Result>
+    std::string r;
+    for(char c : s){
+        if(c == '&') r += "&amp;"; else if(c == '<') r += "&lt;"; else if(c == '>') r += "&gt;"; else if(c == '"') r += "&quot;"; else r += c;
+    }
+    return r;
+}
+//------------------------------------------------------------------------------------------------------------------------------
+static int entity(){ // 1000 escaped <item> elements: the replacestr() chain on each item against one streaming tokenizer pass
+    const int N = 1000;
+    std::vector<std::string> items;
+    std::string didl = "<DIDL-Lite xmlns:dc=\"http://purl.org/dc/elements/1.1/\" xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\">";
+    for(int i = 0; i < N; i++){
+        char b[600];
+        snprintf(b, sizeof(b), "<item id=\"64$1$%d\" parentID=\"64$1\" restricted=\"1\"><dc:title>Caf&#233; Track %d &quot;x&quot; &amp; y</dc:title>"
+                               "<upnp:class>object.item.audioItem.musicTrack</upnp:class><res size=\"%d\" duration=\"0:03:%02d.000\" "
+                               "protocolInfo=\"http-get:*:audio/mpeg:*\">http://192.168.1.2:8200/MediaItems/%d.mp3</res></item>", i, i, 1000000 + i, i % 60, i);
+        didl += b;
+        items.push_back(escape(b));
+    }
+    didl += "</DIDL-Lite>";
+    std::string soap = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\"><s:Body><u:BrowseResponse><Result>" + escape(didl) +
+                       "</Result><NumberReturned>1000</NumberReturned><TotalMatches>1000</TotalMatches></u:BrowseResponse></s:Body></s:Envelope>";
+
+    char buf[2048];
+    uint32_t bestOld = UINT32_MAX, bestNew = UINT32_MAX;
+    for(int k = 0; k < 5; k++){
+        uint32_t t = usNow(CLOCK_THREAD_CPUTIME_ID);
+        for(auto& it : items){ // the old reader split the text at ';' and collected one item in m_chbuf
+            char* p = buf;
+            for(char c : it) if(c != ';') *p++ = c;
+            *p = '\0';
+            replacestr(buf, "&quot", "\"");
+            replacestr(buf, "&ampamp", "&");
+            replacestr(buf, "&ampapos", "'");
+            replacestr(buf, "&ampquot", "\"");
+            replacestr(buf, "&lt", "<");
+            replacestr(buf, "&gt", ">");
+        }
+        t = usNow(CLOCK_THREAD_CPUTIME_ID) - t;
+        if(t < bestOld) bestOld = t;
+
+        dlna.srvContent_clear();
+        t = usNow(CLOCK_THREAD_CPUTIME_ID);
+        dlna.xmlInit(dlna.m_soapTok, DLNA_Client::XML_SOAP);
+        dlna.xmlParse(dlna.m_soapTok, soap.c_str(), soap.size());
+        t = usNow(CLOCK_THREAD_CPUTIME_ID) - t;
+        if(t < bestNew) bestNew = t;
+    }
+    printf("replacestr() chain, entities only: %6.2f ms\n", bestOld / 1000.0);
+    printf("tokenizer, all parsing and storing: %6.2f ms, %u items, last title '%s'\n", bestNew / 1000.0, dlna.getItemCount(),
+           dlna.getItemCount() ? dlna.getItem(dlna.getItemCount() - 1).title : "");
+    return 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------
+static int cbor(uint16_t port){ // one browse result as JSON (string and Print) and as CBOR: encoded size and encode time
+    uint16_t items = getenv("ITEMS") ? atoi(getenv("ITEMS")) : 1000;
+    if(!seek(port)) {printf("no server\n"); return 1;}
+    dlna.browseServer(0, "0", 0, items);
+    idle();
+    size_t size = 512 * 1024;
+    uint8_t* buf = (uint8_t*)malloc(size);
+    size_t jsonLen = 0, printLen = 0, cborLen = 0;
+    uint32_t bestJson = UINT32_MAX, bestCbor = UINT32_MAX, bestStr = UINT32_MAX;
+    for(int k = 0; k < 5; k++){
+        uint32_t t = usNow(CLOCK_THREAD_CPUTIME_ID);
+        jsonLen = strlen(dlna.stringifyContent());
+        t = usNow(CLOCK_THREAD_CPUTIME_ID) - t;
+        if(t < bestStr) bestStr = t;
+
+        t = usNow(CLOCK_THREAD_CPUTIME_ID);
+        cborLen = dlna.cborContent(buf, size);
+        t = usNow(CLOCK_THREAD_CPUTIME_ID) - t;
+        if(t < bestCbor) bestCbor = t;
+    }
+    struct NullPrint : public Print { // counts only, the time of the JSON writer itself
+        size_t len = 0;
+        size_t write(uint8_t) override {len++; return 1;}
+        size_t write(const uint8_t*, size_t n) override {len += n; return n;}
+    };
+    for(int k = 0; k < 5; k++){
+        NullPrint out;
+        uint32_t t = usNow(CLOCK_THREAD_CPUTIME_ID);
+        dlna.printContent(out);
+        t = usNow(CLOCK_THREAD_CPUTIME_ID) - t;
+        if(t < bestJson) bestJson = t;
+        printLen = out.len;
+    }
+    printf("%u items\n", dlna.getItemCount());
+    printf("stringifyContent(): %7u bytes %6.2f ms\n", (unsigned)jsonLen, bestStr / 1000.0);
+    printf("printContent():     %7u bytes %6.2f ms\n", (unsigned)printLen, bestJson / 1000.0);
+    printf("cborContent():      %7u bytes %6.2f ms\n", (unsigned)cborLen, bestCbor / 1000.0);
+    free(buf);
+    return 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------
+int main(int argc, char** argv){
+    setvbuf(stdout, NULL, _IONBF, 0);
+    std::string sc = argc > 1 ? argv[1] : "rx";
+    uint16_t port = getenv("PORT") ? atoi(getenv("PORT")) : 8200;
+    if(sc == "rx") return rx(port);
+    if(sc == "entity") return entity();
+    if(sc == "cbor") return cbor(port);
+    printf("usage: bench rx | entity | cbor\n");
+    return 1;
+}
@@ -0,0 +1,75 @@
+# minimal ContentDirectory server for the host benchmarks: python3 fake_server.py [port] [len|chunked|close] [items]
+import os, http.server, socketserver, sys, re, html, time
+PORT = int(sys.argv[1]) if len(sys.argv) > 1 else 8200
+MODE = sys.argv[2] if len(sys.argv) > 2 else "len"   # len: Content-Length, chunked, close: end of body by EOF
+NITEMS = int(sys.argv[3]) if len(sys.argv) > 3 else 1000
+SLOW = float(os.environ.get("SLOW", "0"))            # seconds before each SOAP response
+DESC = """<?xml version="1.0"?>
+<root xmlns="urn:schemas-upnp-org:device-1-0"><specVersion><major>1</major><minor>0</minor></specVersion>
+<device><deviceType>urn:schemas-upnp-org:device:MediaServer:1</deviceType><friendlyName>Fake &amp; Server</friendlyName>
+<UDN>uuid:4d696e69-444c-164e-9d41-%d</UDN>
+<presentationURL>http://127.0.0.1:%d/</presentationURL>
+<serviceList><service><serviceType>urn:schemas-upnp-org:service:ContentDirectory:1</serviceType><serviceId>urn:upnp-org:serviceId:ContentDirectory</serviceId><controlURL>/ctl/ContentDir</controlURL></service></serviceList></device></root>
+""" % (PORT, PORT)
+
+def didl(oid, start, count, flag):
+    a = html.escape(oid, quote=True)
+    rng = [0] if flag == "BrowseMetadata" else range(start, min(start + count, NITEMS) if count else NITEMS)
+    items = []
+    for i in rng:
+        if oid == "0" and i < 2 and flag != "BrowseMetadata":
+            items.append('<container id="64$%d" parentID="%s" restricted="1" searchable="1" childCount="%d"><dc:title>Folder %d &amp; Co</dc:title>'
+                         '<upnp:class>object.container.storageFolder</upnp:class></container>' % (i, a, i + 3, i))
+        else:
+            items.append('<item id="%s$%d" parentID="%s" restricted="1"><dc:title>Caf&#233; Track %d &quot;x&quot; &amp; y</dc:title><upnp:artist>A</upnp:artist>'
+                         '<upnp:class>object.item.audioItem.musicTrack</upnp:class><upnp:albumArtURI>http://127.0.0.1:%d/art/%d.jpg</upnp:albumArtURI>'
+                         '<res size="%d" duration="0:03:%02d.000" bitrate="40000" protocolInfo="http-get:*:audio/mpeg:DLNA.ORG_PN=MP3">http://127.0.0.1:%d/MediaItems/%d.mp3</res></item>'
+                         % (a, i, a, i, PORT, i, 1000000 + i, i % 60, PORT, i))
+    d = ('<DIDL-Lite xmlns:dc="http://purl.org/dc/elements/1.1/" xmlns:upnp="urn:schemas-upnp-org:metadata-1-0/upnp/" '
+         'xmlns="urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/">' + "".join(items) + '</DIDL-Lite>')
+    return d, len(items), 1 if flag == "BrowseMetadata" else NITEMS
+
+def envelope(action, inner):
+    return ('<?xml version="1.0" encoding="utf-8"?>\n<s:Envelope xmlns:s="http://schemas.xmlsoap.org/soap/envelope/" s:encodingStyle="http://schemas.xmlsoap.org/soap/encoding/">'
+            '<s:Body><u:%sResponse xmlns:u="urn:schemas-upnp-org:service:ContentDirectory:1">%s</u:%sResponse></s:Body></s:Envelope>\r\n' % (action, inner, action))
+
+class H(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    def log_message(self, *a): pass
+    def send_body(self, body):
+        body = body.encode()
+        close = MODE == "close" or self.headers.get("Connection", "").lower() == "close"
+        self.send_response(200)
+        self.send_header("Content-Type", 'text/xml; charset="utf-8"')
+        if MODE == "chunked": self.send_header("Transfer-Encoding", "chunked")
+        elif MODE != "close": self.send_header("Content-Length", str(len(body)))
+        if close: self.send_header("Connection", "close")
+        self.end_headers()
+        if MODE == "chunked":
+            for i in range(0, len(body), 700):
+                c = body[i:i + 700]
+                self.wfile.write(b"%x\r\n" % len(c) + c + b"\r\n")
+            self.wfile.write(b"0\r\n\r\n")
+        else:
+            self.wfile.write(body)
+        self.wfile.flush()
+        if close: self.close_connection = True
+    def do_GET(self):
+        if self.path.startswith("/rootDesc.xml"): self.send_body(DESC)
+        else: self.send_error(404)
+    def do_POST(self):
+        req = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode()
+        act = self.headers.get("SOAPAction", "").split("#")[-1].strip('"')
+        if SLOW: time.sleep(SLOW)
+        if act == "GetSystemUpdateID": return self.send_body(envelope(act, "<Id>5</Id>"))
+        if act == "GetSearchCapabilities": return self.send_body(envelope(act, "<SearchCaps>dc:title,upnp:artist,upnp:class</SearchCaps>"))
+        g = lambda t, d="": (re.search("<%s>(.*?)</%s>" % (t, t), req, re.S) or [None, d])[1]
+        oid = html.unescape(g("ObjectID", g("ContainerID", "0")))
+        d, nr, tm = didl(oid, int(g("StartingIndex", "0")), int(g("RequestedCount", "0")), g("BrowseFlag", "Search"))
+        self.send_body(envelope(act, "<Result>%s</Result>\n<NumberReturned>%d</NumberReturned>\n<TotalMatches>%d</TotalMatches>\n<UpdateID>5</UpdateID>"
+                                % (html.escape(d, quote=True), nr, tm)))
+
+class S(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+S(("127.0.0.1", PORT), H).serve_forever()
@@ -0,0 +1,86 @@
+#pragma once
+// host stand-ins for the Arduino-ESP32 API, just enough to build src/DLNAClient.cpp with g++ (extras/host_bench)
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+typedef unsigned int uint;
+#ifndef __FILENAME__
+#define __FILENAME__ __FILE__
+#endif
+#define log_e(fmt, ...) printf("[E] " fmt "\n", ##__VA_ARGS__)
+#define log_w(fmt, ...) printf("[W] " fmt "\n", ##__VA_ARGS__)
+#define log_i(fmt, ...) printf("[I] " fmt "\n", ##__VA_ARGS__)
+#define log_d(fmt, ...) do{}while(0)
+#define log_v(fmt, ...) do{}while(0)
+static inline unsigned long millis(){ struct timespec ts; clock_gettime(CLOCK_MONOTONIC,&ts); return ts.tv_sec*1000ULL + ts.tv_nsec/1000000; }
+static inline unsigned long micros(){ struct timespec ts; clock_gettime(CLOCK_MONOTONIC,&ts); return ts.tv_sec*1000000ULL + ts.tv_nsec/1000; }
+static inline void delay(uint32_t ms){ usleep(ms*1000); }
+extern bool g_mock_psram;
+static inline bool psramInit(){ return g_mock_psram; }
+static inline bool psramFound(){ return g_mock_psram; }
+static inline void* ps_malloc(size_t n){ return malloc(n); }
+static inline void* ps_calloc(size_t n, size_t m){ return calloc(n,m); }
+static inline void* ps_realloc(void* p, size_t n){ return realloc(p,n); }
+static inline char toLowerCase(char c){ return tolower(c); }
+static inline char* itoa(int v, char* s, int b){ sprintf(s, b==16?"%x":"%d", v); return s; }
+static inline char* ltoa(long v, char* s, int b){ sprintf(s, b==16?"%lx":"%ld", v); return s; }
+static inline char* utoa(unsigned v, char* s, int b){ sprintf(s, b==16?"%x":"%u", v); return s; }
+static inline char* ultoa(unsigned long v, char* s, int b){ sprintf(s, b==16?"%lx":"%lu", v); return s; }
+static inline size_t strlcpy(char* d, const char* s, size_t n){ size_t l = strlen(s); if(n){ size_t c = l < n-1 ? l : n-1; memcpy(d,s,c); d[c]=0;} return l; }
+static inline size_t strlcat(char* d, const char* s, size_t n){ size_t dl = strnlen(d,n); if(dl==n) return n+strlen(s); return dl + strlcpy(d+dl, s, n-dl); }
+#define MALLOC_CAP_SPIRAM 1
+#define MALLOC_CAP_INTERNAL 2
+#define MALLOC_CAP_8BIT 4
+#define MALLOC_CAP_DEFAULT 4
+static inline void* heap_caps_malloc(size_t n, uint32_t){ return malloc(n); }
+static inline void* heap_caps_realloc(void* p, size_t n, uint32_t){ return realloc(p,n); }
+static inline size_t heap_caps_get_free_size(uint32_t){ return 100000; }
+static inline size_t heap_caps_get_largest_free_block(uint32_t){ return 100000; }
+static inline uint32_t esp_get_free_heap_size(){ return 100000; }
+static inline int64_t esp_timer_get_time(){ return micros(); }
+class Print {
+public:
+    virtual ~Print(){}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* b, size_t n){ size_t k=0; while(n--) k += write(*b++); return k; }
+    size_t write(const char* s){ return write((const uint8_t*)s, strlen(s)); }
+    size_t write(const char* s, size_t n){ return write((const uint8_t*)s, n); }
+    size_t print(const char* s){ return write(s); }
+    size_t printf(const char* fmt, ...) __attribute__((format(printf,2,3)));
+    virtual void flush(){}
+};
+inline size_t Print::printf(const char* fmt, ...){ char b[512]; va_list a; va_start(a,fmt); int n = vsnprintf(b,sizeof b,fmt,a); va_end(a); return write((const uint8_t*)b, n < 512 ? n : 511); }
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    unsigned long _timeout = 1000;
+    void setTimeout(unsigned long t){ _timeout = t; }
+};
+class HardwareSerial : public Stream {
+public:
+    size_t write(uint8_t c) override { return fwrite(&c,1,1,stdout); }
+    size_t write(const uint8_t* b, size_t n) override { return fwrite(b,1,n,stdout); }
+    using Print::write;
+    int available() override { return 0; } int read() override { return -1; } int peek() override { return -1; }
+    void begin(int){} void println(const char* s=""){ ::printf("%s\n", s); }
+};
+extern HardwareSerial Serial;
+#include <stdarg.h>
+#include <string>
+class String : public std::string { public: using std::string::string; String(const std::string& s):std::string(s){} };
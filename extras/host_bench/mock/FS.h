@@ -0,0 +1,38 @@
+#pragma once
+#include "Arduino.h"
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+namespace fs {
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+class File : public Stream {
+public:
+    FILE* f = nullptr;
+    File(){} File(FILE* x):f(x){}
+    size_t write(uint8_t c) override { return f ? fwrite(&c,1,1,f) : 0; }
+    size_t write(const uint8_t* b, size_t n) override { return f ? fwrite(b,1,n,f) : 0; }
+    using Print::write;
+    int available() override { if(!f) return 0; long p = ftell(f); fseek(f,0,SEEK_END); long e = ftell(f); fseek(f,p,SEEK_SET); return e-p; }
+    int read() override { return f ? fgetc(f) : -1; }
+    size_t read(uint8_t* b, size_t n){ return f ? fread(b,1,n,f) : 0; }
+    int peek() override { int c = read(); if(c>=0) ungetc(c,f); return c; }
+    bool seek(uint32_t pos, SeekMode m = SeekSet){ return f && fseek(f,pos,(int)m)==0; }
+    size_t position(){ return f ? ftell(f) : 0; }
+    size_t size(){ if(!f) return 0; long p = ftell(f); fseek(f,0,SEEK_END); long e = ftell(f); fseek(f,p,SEEK_SET); return e; }
+    void flush() override { if(f) fflush(f); }
+    void close(){ if(f) fclose(f); f = nullptr; }
+    operator bool() const { return f != nullptr; }
+};
+class FS {
+public:
+    std::string root = "/tmp/mockfs";
+    File open(const char* p, const char* m = FILE_READ, bool = false){ std::string s = root + p; return File(fopen(s.c_str(), m)); }
+    bool exists(const char* p){ std::string s = root + p; return access(s.c_str(), F_OK) == 0; }
+    bool remove(const char* p){ std::string s = root + p; return ::remove(s.c_str()) == 0; }
+    bool rename(const char* a, const char* b){ std::string s = root + a, t = root + b; return ::rename(s.c_str(), t.c_str()) == 0; }
+    bool mkdir(const char* p){ std::string s = root + p; return ::mkdir(s.c_str(), 0755) == 0 || errno == EEXIST; }
+};
+}
+using fs::File;
+using fs::FS;
+#include <sys/stat.h>
@@ -0,0 +1,4 @@
+#pragma once
+#include "FS.h"
+class LittleFSFS : public fs::FS { public: bool begin(bool = false, const char* = "/littlefs", uint8_t = 10, const char* = "spiffs"){ ::mkdir(root.c_str(), 0755); return true; } };
+extern LittleFSFS LittleFS;
@@ -0,0 +1,19 @@
+#pragma once
+#include "Arduino.h"
+#include <map>
+#include <string>
+class Preferences {
+public:
+    static std::map<std::string, std::string> store;
+    std::string ns;
+    bool begin(const char* n, bool ro=false){ ns=n; (void)ro; return true; }
+    void end(){}
+    size_t putBytes(const char* k, const void* v, size_t n){ store[ns+"/"+k] = std::string((const char*)v, n); return n; }
+    size_t getBytesLength(const char* k){ auto it = store.find(ns+"/"+k); return it==store.end()?0:it->second.size(); }
+    size_t getBytes(const char* k, void* buf, size_t n){ auto it = store.find(ns+"/"+k); if(it==store.end()) return 0; size_t c = it->second.size()<n?it->second.size():n; memcpy(buf,it->second.data(),c); return c; }
+    bool remove(const char* k){ return store.erase(ns+"/"+k); }
+    bool clear(){ return true; }
+    size_t putUInt(const char* k, uint32_t v){ return putBytes(k,&v,4); }
+    uint32_t getUInt(const char* k, uint32_t d=0){ uint32_t v=d; getBytes(k,&v,4); return v; }
+    bool isKey(const char* k){ return store.count(ns+"/"+k); }
+};
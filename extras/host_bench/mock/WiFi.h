@@ -0,0 +1,74 @@
+#pragma once
+#include "Arduino.h"
+#include "lwip/sockets.h"
+#include <deque>
+#include <vector>
+#include <memory>
+class IPAddress {
+public:
+    uint8_t b[4] = {0,0,0,0};
+    IPAddress(){}
+    IPAddress(uint8_t a, uint8_t c, uint8_t d, uint8_t e){ b[0]=a;b[1]=c;b[2]=d;b[3]=e; }
+    IPAddress(uint32_t v){ memcpy(b,&v,4); }
+    bool fromString(const char* s){ unsigned x[4]; if(sscanf(s,"%u.%u.%u.%u",&x[0],&x[1],&x[2],&x[3])!=4) return false; for(int i=0;i<4;i++) b[i]=x[i]; return true; }
+    operator uint32_t() const { uint32_t v; memcpy(&v,b,4); return v; }
+    uint8_t operator[](int i) const { return b[i]; }
+    String toString() const { char s[16]; sprintf(s,"%u.%u.%u.%u",b[0],b[1],b[2],b[3]); return String(s); }
+};
+#define WL_CONNECTED 3
+#define WIFI_STA 1
+class WiFiClass { public: void mode(int){} void disconnect(bool=false){} int status(){ return WL_CONNECTED; } IPAddress localIP(){ return IPAddress(127,0,0,1); } };
+extern WiFiClass WiFi;
+extern uint32_t g_mock_call_ns;
+static inline void callCost(){ // every call into the client costs time on the ESP32 (lwIP, locks), the loopback socket is almost free
+    if(!g_mock_call_ns) return;
+    struct timespec t0, t; clock_gettime(CLOCK_MONOTONIC, &t0);
+    do clock_gettime(CLOCK_MONOTONIC, &t); while((t.tv_sec - t0.tv_sec) * 1000000000L + t.tv_nsec - t0.tv_nsec < (long)g_mock_call_ns);
+}
+class WiFiClient : public Stream {
+    struct H { int fd; H(int f):fd(f){} ~H(){ if(fd>=0) ::close(fd);} };
+    std::shared_ptr<H> h;
+    uint8_t rb[1436] = {}; size_t rpos=0, rlen=0; bool eof=false;
+    int fill(){ if(rpos<rlen) return rlen-rpos; if(!h) return 0; ssize_t n = recv(h->fd, rb, sizeof rb, MSG_DONTWAIT); if(n>0){rpos=0;rlen=n;return n;} if(n==0) eof=true; else if(errno!=EAGAIN && errno!=EWOULDBLOCK) eof=true; return 0; }
+public:
+    WiFiClient(){}
+    WiFiClient(int fd){ h = std::make_shared<H>(fd); }
+    int connect(const char* host, uint16_t port){ return connect(host, port, _timeout); }
+    int connect(const char* host, uint16_t port, int32_t){ stop(); int fd = socket(AF_INET, SOCK_STREAM, 0); sockaddr_in a{}; a.sin_family=AF_INET; a.sin_port=htons(port); inet_pton(AF_INET, host, &a.sin_addr); if(::connect(fd,(sockaddr*)&a,sizeof a)<0){ ::close(fd); return 0;} h = std::make_shared<H>(fd); return 1; }
+    void stop(){ h.reset(); rpos=rlen=0; eof=false; }
+    uint8_t connected(){ callCost(); if(!h) return 0; fill(); return !eof || rpos<rlen; }
+    int available() override { callCost(); return fill(); }
+    int read() override { callCost(); if(!fill()) return -1; return rb[rpos++]; }
+    int read(uint8_t* buf, size_t n){ callCost(); if(!fill()) return -1; size_t c = rlen-rpos < n ? rlen-rpos : n; memcpy(buf, rb+rpos, c); rpos += c; return c; }
+    int read(char* buf, size_t n){ return read((uint8_t*)buf, n); }
+    int peek() override { callCost(); if(!fill()) return -1; return rb[rpos]; }
+    size_t write(uint8_t c) override { return write(&c,1); }
+    size_t write(const uint8_t* b, size_t n) override { if(!h) return 0; ssize_t k = send(h->fd, b, n, MSG_NOSIGNAL); return k<0?0:k; }
+    using Print::write;
+    int fd() const { return h ? h->fd : -1; }
+    int setNoDelay(bool){ return 0; }
+    explicit operator bool(){ return connected(); }
+};
+class WiFiUDP : public Stream {
+public:
+    static std::deque<std::pair<std::string, std::pair<IPAddress,uint16_t>>> rxq;
+    static std::vector<std::pair<std::string, std::pair<IPAddress,uint16_t>>> txlog;
+    std::string cur; size_t cpos=0; std::string out; IPAddress oip; uint16_t oport=0; bool open=false; uint16_t lport=0;
+    IPAddress rip; uint16_t rport=0;
+    uint8_t begin(uint16_t p){ open=true; lport=p; return 1; }
+    uint8_t beginMulticast(IPAddress, uint16_t p){ open=true; lport=p; return 1; }
+    void stop(){ open=false; }
+    int beginPacket(IPAddress ip, uint16_t port){ out.clear(); oip=ip; oport=port; return 1; }
+    int endPacket(){ txlog.push_back({out,{oip,oport}}); return 1; }
+    size_t write(uint8_t c) override { out.push_back(c); return 1; }
+    size_t write(const uint8_t* b, size_t n) override { out.append((const char*)b, n); return n; }
+    using Print::write;
+    int parsePacket(){ if(!open) return 0; for(auto it = rxq.begin(); it != rxq.end(); ++it){ if(it->second.second == lport || it->second.second == 0){ cur = it->first; rip = it->second.first; rport = 1900; rxq.erase(it); cpos=0; return cur.size(); } } return 0; }
+    int available() override { return cur.size()-cpos; }
+    int read() override { return cpos<cur.size() ? (uint8_t)cur[cpos++] : -1; }
+    int read(unsigned char* b, size_t n){ size_t c = cur.size()-cpos < n ? cur.size()-cpos : n; memcpy(b, cur.data()+cpos, c); cpos+=c; return c; }
+    int read(char* b, size_t n){ return read((unsigned char*)b, n); }
+    int peek() override { return cpos<cur.size() ? (uint8_t)cur[cpos] : -1; }
+    IPAddress remoteIP(){ return rip; }
+    uint16_t remotePort(){ return rport; }
+};
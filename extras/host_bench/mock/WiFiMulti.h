@@ -0,0 +1,3 @@
+#pragma once
+#include "WiFi.h"
+class WiFiMulti { public: void addAP(const char*, const char*){} int run(){ return WL_CONNECTED; } };
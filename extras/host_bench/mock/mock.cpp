@@ -0,0 +1,39 @@
+// definitions for the host stand-ins in this directory
+#include "Arduino.h"
+#include "WiFi.h"
+#include "Preferences.h"
+#include "LittleFS.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+bool g_mock_psram = true;
+uint32_t g_mock_call_ns = getenv("CALL_NS") ? atoi(getenv("CALL_NS")) : 1000; // cost of one WiFiClient call, 0: none
+HardwareSerial Serial;
+WiFiClass WiFi;
+LittleFSFS LittleFS;
+std::deque<std::pair<std::string, std::pair<IPAddress,uint16_t>>> WiFiUDP::rxq;
+std::vector<std::pair<std::string, std::pair<IPAddress,uint16_t>>> WiFiUDP::txlog;
+std::map<std::string, std::string> Preferences::store;
+void vTaskDelay(TickType_t t){ usleep(t*1000); }
+TickType_t xTaskGetTickCount(){ return millis(); }
+struct MQ { std::mutex m; std::condition_variable cv; std::deque<std::string> q; size_t isz, cap; };
+QueueHandle_t xQueueCreate(UBaseType_t len, UBaseType_t sz){ auto q = new MQ; q->isz = sz; q->cap = len; return q; }
+BaseType_t xQueueSend(QueueHandle_t h, const void* it, TickType_t){ auto q=(MQ*)h; std::lock_guard<std::mutex> l(q->m); if(q->q.size()>=q->cap) return pdFALSE; q->q.emplace_back((const char*)it, q->isz); q->cv.notify_one(); return pdTRUE; }
+BaseType_t xQueueReceive(QueueHandle_t h, void* it, TickType_t t){ auto q=(MQ*)h; std::unique_lock<std::mutex> l(q->m); if(!q->cv.wait_for(l, std::chrono::milliseconds(t==portMAX_DELAY?1000000000:t), [&]{return !q->q.empty();})) return pdFALSE; memcpy(it, q->q.front().data(), q->isz); q->q.pop_front(); return pdTRUE; }
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t h){ auto q=(MQ*)h; std::lock_guard<std::mutex> l(q->m); return q->q.size(); }
+void vQueueDelete(QueueHandle_t h){ delete (MQ*)h; }
+SemaphoreHandle_t xSemaphoreCreateMutex(){ return new std::recursive_mutex; }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(){ return new std::recursive_mutex; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t){ ((std::recursive_mutex*)s)->lock(); return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s){ ((std::recursive_mutex*)s)->unlock(); return pdTRUE; }
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t s, TickType_t t){ return xSemaphoreTake(s,t); }
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t s){ return xSemaphoreGive(s); }
+void vSemaphoreDelete(SemaphoreHandle_t s){ delete (std::recursive_mutex*)s; }
+static thread_local void* g_curTask = nullptr;
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t f, const char*, uint32_t, void* p, UBaseType_t, TaskHandle_t* h, BaseType_t){ void* id = new char; if(h) *h = id; std::thread([=]{ g_curTask = id; f(p); }).detach(); return pdPASS; }
+void vTaskDelete(TaskHandle_t){ }
+TaskHandle_t xTaskGetCurrentTaskHandle(){ return g_curTask; }
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t){ return 1000; }
+void xTaskNotifyGive(TaskHandle_t){}
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t t){ usleep(t*1000); return 0; }
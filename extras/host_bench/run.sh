@@ -0,0 +1,10 @@
+#!/bin/sh
+# builds the library with the host stand-ins and runs one benchmark: ./run.sh rx | entity | cbor
+cd "$(dirname "$0")" || exit 1
+g++ -std=gnu++11 -O2 -Wall -Wextra -Imock -I../../src bench.cpp ../../src/DLNAClient.cpp mock/mock.cpp -o bench -lpthread || exit 1
+PORT=${PORT:-8200}
+python3 fake_server.py $PORT ${MODE:-len} ${ITEMS:-1000} & SRV=$!
+sleep 0.5
+PORT=$PORT ./bench "$@"; RES=$?
+kill $SRV
+exit $RES
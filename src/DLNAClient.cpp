@@ -1,7 +1,7 @@
 #include "DLNAClient.h"
 
 // Created on: 30.11.2023
-// Updated on: 01.08.2025
+// Updated on: 17.10.2026
 /*
 //example
 DLNA dlna;
@@ -22,196 +22,767 @@ DLNA_Client::DLNA_Client(){
     m_PSRAMfound = psramInit();
     m_chbuf = (char*)malloc(512);
     m_chbufSize = 512;
+    memset(m_srvIndex, 0xFF, sizeof(m_srvIndex));
+    m_reqMutex = xSemaphoreCreateMutex();
+    m_resultQueue = xQueueCreate(DLNA_QUEUE_LEN, sizeof(dlnaResult_t)); // before any request, the task and the application use it
 }
 
 DLNA_Client::~DLNA_Client(){
+    if(m_task && xTaskGetCurrentTaskHandle() == m_task) {log_e("the task can't destroy its own client"); return;}
+    while(!stopTask()) {;} // the task uses everything below until it has ended
+    crawlAbort();
+    indexAbort();
+    if(m_notifyEnabled) m_udpNotify.stop();
+    if(m_stepFd >= 0) close(m_stepFd); // setLoopBudget(), connect in progress
     dlnaServer_clear_and_shrink();
     srvContent_clear_and_shrink();
-    vector_clear_and_shrink(m_content);
+    vector_clear_and_shrink(m_expectedIP);
     if(m_chbuf){free(m_chbuf); m_chbuf = NULL;}
+    if(m_rxBuf){free(m_rxBuf); m_rxBuf = NULL;}
+    clearBrowseCache();
+    if(m_capture){free(m_capture); m_capture = NULL;}
+    for(uint16_t i = 0; i < m_searchCaps.size(); i++) free(m_searchCaps[i].caps);
+    if(m_searchCriteria){free(m_searchCriteria); m_searchCriteria = NULL;}
+    if(m_objectId){free(m_objectId); m_objectId = NULL;}
+    for(uint8_t i = 0; i < DLNA_QUEUE_LEN; i++) {if(m_req[i].handle) {m_req[i].state = RQ_SENT; requestRelease(i, 0);}}
+    if(m_resultQueue){vQueueDelete(m_resultQueue); m_resultQueue = NULL;}
+    if(m_mutex){vSemaphoreDelete(m_mutex); m_mutex = NULL;}
+    if(m_reqMutex){vSemaphoreDelete(m_reqMutex); m_reqMutex = NULL;}
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool DLNA_Client::seekServer(){
+bool DLNA_Client::seekServer(uint8_t mx, uint8_t expectedServers){
     if(WiFi.status() != WL_CONNECTED) return false; // guard
 
-    if(m_chbuf) {free(m_chbuf); m_chbuf = NULL;}
-    if(m_PSRAMfound == false) {
-        m_chbuf = (char*)malloc(512);
-        m_chbufSize = 512;
-    }
-    else {
-        m_chbuf = (char*)ps_malloc(4 * 4096);
-        m_chbufSize = 4 *4096;
-    }
+    if(m_state == BROWSE_SERVER || m_state == SEARCH_SERVER) {log_e("state is not idle"); return false;}
 
+    chbuf_alloc();
+    for(uint8_t i = 0; i < DLNA_MAX_FETCH; i++) fetchAbort(m_fetch[i]); // a running GET_SERVER_ITEMS belongs to the old server table
+    if(m_verifyActive || m_state == SEEK_SERVER) m_udp.stop();
+    m_state = IDLE;
+    m_resolvePending = false;
+    m_verifyActive = false;
+    m_verified = 0;
+    m_probing = 0;
     dlnaServer_clear_and_shrink();
     m_dlnaServer.size = 0;
-    uint8_t ret = 0;
-    const char searchTX[] = "M-SEARCH * HTTP/1.1\r\n"\
-                            "HOST: 239.255.255.250:1900\r\n"\
-                            "MAN: \"ssdp:discover\"\r\n"\
-                            "MX: 3\r\n"\
-                            "ST: urn:schemas-upnp-org:device:MediaServer:1\r\n\r\n";
-
-    {
-            ret = m_udp.beginMulticast(IPAddress(SSDP_MULTICAST_IP), SSDP_LOCAL_PORT);
-            if(!ret){
-                m_udp.stop(); log_e("error sending SSDP multicast packets");
-                return false;
-            }
-            for (int i = 0; i < 3; i++) {
-                ret = m_udp.beginPacket(IPAddress(SSDP_MULTICAST_IP), SSDP_MULTICAST_PORT);
-                if(!ret){
-                    log_e("udp beginPacket error");
-                    return false;
-                }
-                ret = m_udp.write((const uint8_t*)searchTX, strlen(searchTX));
-                if(!ret){
-                    log_e("udp write error");
-                    return false;
-                }
-                ret = m_udp.endPacket();
-                if(!ret){
-                    log_e("endPacket error");
-                    return false;
-                }
-                vTaskDelay(100 / portTICK_PERIOD_MS);
-            }
-        }
+
+    if(mx < 1) mx = 1;  // UPnP 1.1: MX must be 1...5
+    if(mx > 5) mx = 5;
+    m_mx = mx;
+    m_expectedServers = expectedServers;
+    m_seekWindow = m_mx * 1000 + SSDP_GRACE_TIME;
+    if(m_seekWindow > SEEK_TIMEOUT) m_seekWindow = SEEK_TIMEOUT;
+
+    uint8_t ret = m_udp.begin(m_ssdpPort); // the answers come by unicast to this port, the multicast group is not needed
+    if(!ret){
+        m_udp.stop(); log_e("error sending SSDP multicast packets");
+        return false;
+    }
+    m_ssdpSent = 0;
+    if(!sendMSearch()){m_udp.stop(); return false;} // the retransmits are sent from loop()
     m_state = SEEK_SERVER;
+    m_seekActive = true;
     m_timeStamp = millis();
     return true;
 }
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::setSsdpPort(uint16_t port){ // local port of the M-SEARCH, 0: a free port, each instance gets its own answers
+    m_ssdpPort = port;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::sendMSearch(const char* ip){ // ip == NULL: multicast, otherwise unicast to this server
+    char searchTX[160];
+    IPAddress addr(SSDP_MULTICAST_IP);
+    if(ip){
+        addr.fromString(ip);
+        sprintf(searchTX, "M-SEARCH * HTTP/1.1\r\n"\
+                          "HOST: %s:1900\r\n"\
+                          "MAN: \"ssdp:discover\"\r\n"\
+                          "ST: urn:schemas-upnp-org:device:MediaServer:1\r\n\r\n", ip);
+    }
+    else{
+        sprintf(searchTX, "M-SEARCH * HTTP/1.1\r\n"\
+                          "HOST: 239.255.255.250:1900\r\n"\
+                          "MAN: \"ssdp:discover\"\r\n"\
+                          "MX: %i\r\n"\
+                          "ST: urn:schemas-upnp-org:device:MediaServer:1\r\n\r\n", m_mx);
+    }
+    uint8_t ret = m_udp.beginPacket(addr, SSDP_MULTICAST_PORT);
+    if(!ret){
+        log_e("udp beginPacket error");
+        return false;
+    }
+    ret = m_udp.write((const uint8_t*)searchTX, strlen(searchTX));
+    if(!ret){
+        log_e("udp write error");
+        return false;
+    }
+    ret = m_udp.endPacket();
+    if(!ret){
+        log_e("endPacket error");
+        return false;
+    }
+    m_ssdpSent++;
+    m_ssdpLastTx = millis();
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::seekComplete(){ // true if all expected servers have answered
+    if(m_expectedIP.size()){
+        for(uint16_t i = 0; i < m_expectedIP.size(); i++){
+            bool found = false;
+            for(int j = 0; j < m_dlnaServer.size; j++){
+                if(strcmp(m_expectedIP[i], m_dlnaServer.ip[j]) == 0) {found = true; break;}
+            }
+            if(!found) return false;
+        }
+        return true;
+    }
+    if(m_expectedServers) return m_dlnaServer.size >= m_expectedServers;
+    return false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::addExpectedServer(const char* ip){
+    if(!ip) return;
+    m_expectedIP.push_back(x_ps_strdup(ip));
+}
+
+void DLNA_Client::clearExpectedServers(){
+    vector_clear_and_shrink(m_expectedIP);
+}
 
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int8_t DLNA_Client::listServer(){
     if(m_state == SEEK_SERVER) return -1; // seek in progress
     for(uint8_t i = 0; i < m_dlnaServer.size; i++){
-        if(dlna_server) dlna_server(i, m_dlnaServer.ip[i], m_dlnaServer.port[i], m_dlnaServer.friendlyName[i], m_dlnaServer.controlURL[i]);
+        cbServer(i);
     }
     return m_dlnaServer.size;
 }
 
-DLNA_Client::dlnaServer_t DLNA_Client::getServer(){
+DLNA_Client::dlnaServer_t DLNA_Client::getServer(){ // copy of the server table, getServerInfo() does not copy
     return m_dlnaServer;
 }
-
-DLNA_Client::srvContent_t DLNA_Client::getBrowseResult(){
-    return m_srvContent;;
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+DLNA_Client::serverInfo_t DLNA_Client::getServerInfo(uint8_t srvNr) const {
+    if(srvNr >= m_dlnaServer.size) return {};
+    return {m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], m_dlnaServer.friendlyName[srvNr], m_dlnaServer.controlURL[srvNr],
+            m_dlnaServer.location[srvNr], m_dlnaServer.presentationURL[srvNr], m_dlnaServer.presentationPort[srvNr], m_dlnaServer.udn[srvNr]};
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+DLNA_Client::srvContent_t DLNA_Client::getBrowseResult(){ // vectors of the result, getItem() and browseItems() read the records without copying
+    srvContent_t res;
+    res.size = m_recordCount;
+    for(uint16_t i = 0; i < m_recordCount; i++){
+        const itemRecord_t& r = m_records[i];
+        res.objectId.push_back(m_pool + r.objectId);
+        res.parentId.push_back(m_pool + r.parentId);
+        res.isAudio.push_back(r.isAudio);
+        res.itemURL.push_back(m_pool + r.itemURL);
+        res.itemSize.push_back(r.itemSize);
+        res.duration.push_back(m_pool + r.duration);
+        res.title.push_back(m_pool + r.title);
+        res.childCount.push_back(r.childCount);
+    }
+    return res;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+DLNA_Client::contentItem_t DLNA_Client::getItem(uint16_t i) const {
+    if(i >= m_recordCount) return {};
+    const itemRecord_t& r = m_records[i];
+    return {m_pool + r.objectId, m_pool + r.parentId, m_pool + r.title, m_pool + r.duration, m_pool + r.itemURL, r.itemSize, r.childCount, r.isAudio};
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::setListener(Listener* listener, uint16_t batchSize){ // events of this instance go to the listener, no weak function is called
+    m_listener = listener;
+    m_batchSize = batchSize;
+    m_batchFirst = m_recordCount; // only what arrives from now on
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cbInfo(const char* info){
+    if(m_listener) m_listener->onInfo(info);
+    else if(dlna_info) dlna_info(info);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cbServer(uint8_t srvNr){
+    if(m_listener) m_listener->onServer(srvNr, getServerInfo(srvNr));
+    else if(dlna_server) dlna_server(srvNr, m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], m_dlnaServer.friendlyName[srvNr], m_dlnaServer.controlURL[srvNr]);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cbServerLost(uint8_t srvNr){ // before the server is removed
+    if(m_listener) m_listener->onServerLost(srvNr, getServerInfo(srvNr));
+    else if(dlna_serverLost) dlna_serverLost(srvNr, m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], m_dlnaServer.friendlyName[srvNr]);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cbSeekReady(){
+    m_reqDone = true;
+    if(m_listener) m_listener->onSeekReady(m_dlnaServer.size);
+    else if(dlna_seekReady) dlna_seekReady(m_dlnaServer.size);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cbItems(){ // the records stored since the last batch
+    if(!m_listener || m_batchFirst >= m_recordCount) return;
+    itemRange batch(this, m_batchFirst, m_recordCount - m_batchFirst);
+    m_batchFirst = m_recordCount;
+    m_listener->onBrowseItems(batch);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cbBrowseReady(){
+    m_reqDone = true;
+    if(m_listener) {cbItems(); m_listener->onBrowseReady(m_numberReturned, m_totalMatches);}
+    else if(dlna_browseReady) dlna_browseReady(m_numberReturned, m_totalMatches);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cbCrawlReady(){
+    if(m_listener) m_listener->onCrawlReady(m_crawl.tracks);
+    else if(dlna_crawlReady) dlna_crawlReady(m_crawl.tracks);
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-void DLNA_Client::parseDlnaServer(uint16_t len){
+void DLNA_Client::parseDlnaServer(uint16_t len){ // response to M-SEARCH
     if(len > m_chbufSize - 1) len = m_chbufSize - 1; // guard
-    char* dummy = strdup("?");
     memset(m_chbuf, 0, m_chbufSize);
-    vTaskDelay(200);
     m_udp.read(m_chbuf, len); // read packet into the buffer
-    char* p = strcasestr(m_chbuf, "Location: http");
-    if(!p) return;
-    int idx1 = indexOf(p, "://",  0) + 3;  // pos IP
-    int idx2 = indexOf(p, ":",  idx1);      // pos ':'
-    int idx3 = indexOf(p, "/",  idx2);      // pos '/'
-    int idx4 = indexOf(p, "\r", idx3);      // pos '\r'
-    *(p + idx2) = '\0';
-    *(p + idx3) = '\0';
-    *(p + idx4) = '\0';
-    for(int i = 0; i< m_dlnaServer.size; i++){
-        if(strcmp(m_dlnaServer.ip[i], p + idx1) == 0){      // same IP
-            if(m_dlnaServer.port[i] == atoi(p + idx2 + 1)){ // same port
-                return;
-            }
-        }
+    registerServer(m_chbuf);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::parseNotify(uint16_t len){ // NOTIFY * HTTP/1.1, ssdp:alive or ssdp:byebye
+    if(len > m_chbufSize - 1) len = m_chbufSize - 1; // guard
+    memset(m_chbuf, 0, m_chbufSize);
+    m_udpNotify.read(m_chbuf, len);
+    if(!startsWith(m_chbuf, "NOTIFY")) return; // M-SEARCH from other control points
+    char nts[24]; char nt[80];
+    ssdpField(m_chbuf, "NTS", nts, sizeof(nts));
+    ssdpField(m_chbuf, "NT", nt, sizeof(nt));
+
+    if(strcmp(nts, "ssdp:byebye") == 0){ // the device sends byebye for every NT, the first one removes the server
+        char usn[128];
+        if(!ssdpField(m_chbuf, "USN", usn, sizeof(usn))) return;
+        char* p = strstr(usn, "::"); if(p) *p = '\0';
+        int16_t idx = findServer(usn);
+        if(idx < 0) return;
+        if(m_state == IDLE) removeServer(idx);
+        else m_dlnaServer.expires[idx] = millis(); // don't shift the server indices during a request, checkServerExpiry() removes it later
+        return;
+    }
+    if(strcmp(nts, "ssdp:alive") == 0){
+        if(!strstr(nt, "device:MediaServer:") && !strstr(nt, "service:ContentDirectory:")) return; // printer, router ...
+        int16_t idx = registerServer(m_chbuf);
+        if(idx < 0) return;
+        if(strcmp(m_dlnaServer.controlURL[idx], "?") == 0) m_resolvePending = true; // new server, get the description from loop()
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int16_t DLNA_Client::registerServer(const char* msg){ // SSDP header block, returns the server index or -1
+
+    char location[256]; char usn[128]; char cc[48];
+    if(!ssdpField(msg, "LOCATION", location, sizeof(location))) return -1;
+    if(!startsWith(location, "http://")) return -1;
+    char* ip = location + 7;                       // http://192.168.178.1:49000/MediaServerDevDesc.xml
+    char* path = strchr(ip, '/');
+    if(!path) return -1;
+    *path = '\0'; path++;
+    uint16_t port = 80;
+    char* colon = strchr(ip, ':');
+    if(colon){*colon = '\0'; port = atoi(colon + 1);}
+    if(strcmp(ip, "0.0.0.0") == 0) {log_e("invalid IP address found %s", ip); return -1;}
+
+    uint32_t maxAge = SSDP_DEFAULT_MAX_AGE;
+    if(ssdpField(msg, "CACHE-CONTROL", cc, sizeof(cc))){ // CACHE-CONTROL: max-age=1800
+        char* p = strcasestr(cc, "max-age");
+        if(p) p = strchr(p, '=');
+        if(p) maxAge = atol(p + 1);
     }
-    if(strcmp(p + idx1, "0.0.0.0") == 0) {log_e("invalid IP address found %s", p + idx1); return;}
-    m_dlnaServer.ip.push_back(x_ps_strdup(p + idx1));
-    m_dlnaServer.port.push_back(atoi(p + idx2 + 1));
-    m_dlnaServer.location.push_back(x_ps_strdup(p + idx3 + 1));
-    m_dlnaServer.controlURL.push_back(dummy);
-    m_dlnaServer.friendlyName.push_back(dummy);
+    if(ssdpField(msg, "USN", usn, sizeof(usn))){     // uuid:4d696e69-444c-164e-9d41-b827eb54e939::urn:schemas-upnp-org:device:MediaServer:1
+        char* p = strstr(usn, "::"); if(p) *p = '\0';
+    }
+    if(!usn[0] && snprintf(usn, sizeof(usn), "%s:%d", ip, port) >= (int)sizeof(usn)) return -1; // no USN, ip:port is the key, the host is not usable
+
+    int16_t idx = findServer(usn);
+    if(idx >= 0){ // known server, refresh
+        m_dlnaServer.expires[idx] = millis() + maxAge * 1000;
+        if(strcmp(m_dlnaServer.ip[idx], ip) == 0 && m_dlnaServer.port[idx] == port && strcmp(m_dlnaServer.location[idx], path) == 0) return idx;
+        // the server has got a new address, the description must be read again
+        free(m_dlnaServer.ip[idx]);           m_dlnaServer.ip[idx] = x_ps_strdup(ip);
+        free(m_dlnaServer.location[idx]);     m_dlnaServer.location[idx] = x_ps_strdup(path);
+        free(m_dlnaServer.controlURL[idx]);   m_dlnaServer.controlURL[idx] = x_ps_strdup("?");
+        m_dlnaServer.port[idx] = port;
+        return idx;
+    }
+    if(m_dlnaServer.size >= DLNA_MAX_SERVERS) {log_e("too many servers"); return -1;}
+
+    m_dlnaServer.ip.push_back(x_ps_strdup(ip));
+    m_dlnaServer.port.push_back(port);
+    m_dlnaServer.location.push_back(x_ps_strdup(path));
+    m_dlnaServer.controlURL.push_back(x_ps_strdup("?"));
+    m_dlnaServer.friendlyName.push_back(x_ps_strdup("?"));
     m_dlnaServer.presentationPort.push_back(0);
-    m_dlnaServer.presentationURL.push_back(dummy);
+    m_dlnaServer.presentationURL.push_back(x_ps_strdup("?"));
+    m_dlnaServer.udn.push_back(x_ps_strdup(usn));
+    m_dlnaServer.expires.push_back(millis() + maxAge * 1000);
     m_dlnaServer.size++;
+
+    uint8_t slot = fnv1a(usn) % (DLNA_MAX_SERVERS * 2);
+    while(m_srvIndex[slot] != 0xFF) slot = (slot + 1) % (DLNA_MAX_SERVERS * 2);
+    m_srvIndex[slot] = m_dlnaServer.size - 1;
+    return m_dlnaServer.size - 1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int16_t DLNA_Client::findServer(const char* udn){
+    uint8_t slot = fnv1a(udn) % (DLNA_MAX_SERVERS * 2);
+    while(m_srvIndex[slot] != 0xFF){
+        if(strcmp(m_dlnaServer.udn[m_srvIndex[slot]], udn) == 0) return m_srvIndex[slot];
+        slot = (slot + 1) % (DLNA_MAX_SERVERS * 2);
+    }
+    return -1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::rebuildServerIndex(){
+    memset(m_srvIndex, 0xFF, sizeof(m_srvIndex));
+    for(uint8_t i = 0; i < m_dlnaServer.size; i++){
+        uint8_t slot = fnv1a(m_dlnaServer.udn[i]) % (DLNA_MAX_SERVERS * 2);
+        while(m_srvIndex[slot] != 0xFF) slot = (slot + 1) % (DLNA_MAX_SERVERS * 2);
+        m_srvIndex[slot] = i;
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::removeServer(uint8_t srvNr){
+    if(srvNr >= m_dlnaServer.size) return;
+    crawlAbort(); // the page is read again with the new server index
+    cbServerLost(srvNr);
+    free(m_dlnaServer.ip[srvNr]);              m_dlnaServer.ip.erase(m_dlnaServer.ip.begin() + srvNr);
+    free(m_dlnaServer.location[srvNr]);        m_dlnaServer.location.erase(m_dlnaServer.location.begin() + srvNr);
+    free(m_dlnaServer.friendlyName[srvNr]);    m_dlnaServer.friendlyName.erase(m_dlnaServer.friendlyName.begin() + srvNr);
+    free(m_dlnaServer.controlURL[srvNr]);      m_dlnaServer.controlURL.erase(m_dlnaServer.controlURL.begin() + srvNr);
+    free(m_dlnaServer.presentationURL[srvNr]); m_dlnaServer.presentationURL.erase(m_dlnaServer.presentationURL.begin() + srvNr);
+    free(m_dlnaServer.udn[srvNr]);             m_dlnaServer.udn.erase(m_dlnaServer.udn.begin() + srvNr);
+    m_dlnaServer.port.erase(m_dlnaServer.port.begin() + srvNr);
+    m_dlnaServer.presentationPort.erase(m_dlnaServer.presentationPort.begin() + srvNr);
+    m_dlnaServer.expires.erase(m_dlnaServer.expires.begin() + srvNr);
+    m_dlnaServer.size--;
+    rebuildServerIndex();
+    uint32_t low = (1UL << srvNr) - 1;   // bits of the servers below srvNr stay, the others move down
+    m_verified = (m_verified & low) | ((m_verified >> 1) & ~low);
+    m_probing  = (m_probing  & low) | ((m_probing  >> 1) & ~low);
+    xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+    for(uint8_t i = 0; i < DLNA_QUEUE_LEN; i++){ // queued requests keep their server, those for this one fail with -2 in requestStart()
+        request_t& r = m_req[i];
+        if(!r.handle || r.type == REQ_SEEK) continue;
+        if(r.srvNr == srvNr) r.srvNr = 0xFF;
+        else if(r.srvNr > srvNr && r.srvNr <= m_dlnaServer.size) r.srvNr--; // an index that was too high stays too high
+    }
+    xSemaphoreGive(m_reqMutex);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::checkServerExpiry(){ // without ssdp:alive within max-age the server is gone
+    if(millis() - m_expiryCheck < 1000) return;
+    m_expiryCheck = millis();
+    for(int16_t i = m_dlnaServer.size - 1; i >= 0; i--){
+        if((int32_t)(millis() - m_dlnaServer.expires[i]) >= 0) removeServer(i);
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::saveServerCache(){ // all resolved servers as a blob in NVS: udn\0ip\0port\0location\0friendlyName\0controlURL\0presentationURL\0presentationPort\0 ...
+    uint32_t len = 1;
+    char port[6]; char pPort[6];
+    for(uint8_t i = 0; i < m_dlnaServer.size; i++){
+        if(strcmp(m_dlnaServer.controlURL[i], "?") == 0) continue; // not resolved
+        len += strlen(m_dlnaServer.udn[i]) + strlen(m_dlnaServer.ip[i]) + strlen(m_dlnaServer.location[i]) + strlen(m_dlnaServer.friendlyName[i]) +
+               strlen(m_dlnaServer.controlURL[i]) + strlen(m_dlnaServer.presentationURL[i]) + 2 * 6 + 8;
+    }
+    char* blob = x_ps_malloc(len);
+    if(!blob) return false;
+    uint32_t pos = 1;
+    uint8_t cnt = 0;
+    auto add = [&](const char* str){ uint16_t l = strlen(str) + 1; memcpy(blob + pos, str, l); pos += l; }; // lambda, inner function
+    for(uint8_t i = 0; i < m_dlnaServer.size; i++){
+        if(strcmp(m_dlnaServer.controlURL[i], "?") == 0) continue;
+        itoa(m_dlnaServer.port[i], port, 10);
+        itoa(m_dlnaServer.presentationPort[i], pPort, 10);
+        add(m_dlnaServer.udn[i]); add(m_dlnaServer.ip[i]); add(port); add(m_dlnaServer.location[i]);
+        add(m_dlnaServer.friendlyName[i]); add(m_dlnaServer.controlURL[i]); add(m_dlnaServer.presentationURL[i]); add(pPort);
+        cnt++;
+    }
+    blob[0] = cnt;
+    Preferences prefs;
+    bool ret = prefs.begin(DLNA_CACHE_NAMESPACE, false);
+    if(ret) ret = (prefs.putBytes("server", blob, pos) == pos);
+    prefs.end();
+    free(blob);
+    if(!ret) log_e("can't write the server cache");
+    return ret;
 }
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::loadServerCache(){ // returns the number of cached servers, they can be browsed at once and are checked in the background
+    if(m_state != IDLE) {log_e("state is not idle"); return -1;}
+    m_cacheEnabled = true;
+    chbuf_alloc();
+    Preferences prefs;
+    if(!prefs.begin(DLNA_CACHE_NAMESPACE, true)) return 0; // no cache yet
+    uint32_t len = prefs.getBytesLength("server");
+    char* blob = NULL;
+    if(len > 1) {blob = x_ps_malloc(len + 1); prefs.getBytes("server", blob, len); blob[len] = '\0';}
+    prefs.end();
+    if(!blob) return 0;
 
+    dlnaServer_clear_and_shrink();
+    uint8_t cnt = blob[0];
+    uint32_t pos = 1;
+    auto next = [&](){ const char* str = blob + pos; pos += strlen(str) + 1; if(pos > len) pos = len; return str; }; // lambda, inner function
+    for(uint8_t i = 0; i < cnt && pos < len && m_dlnaServer.size < DLNA_MAX_SERVERS; i++){
+        const char* udn = next(); const char* ip = next(); uint16_t port = atoi(next()); const char* location = next();
+        const char* friendlyName = next(); const char* controlURL = next(); const char* presentationURL = next(); uint16_t pPort = atoi(next());
+        if(findServer(udn) >= 0) continue; // guard
+        m_dlnaServer.ip.push_back(x_ps_strdup(ip));
+        m_dlnaServer.port.push_back(port);
+        m_dlnaServer.location.push_back(x_ps_strdup(location));
+        m_dlnaServer.controlURL.push_back(x_ps_strdup(controlURL));
+        m_dlnaServer.friendlyName.push_back(x_ps_strdup(friendlyName));
+        m_dlnaServer.presentationPort.push_back(pPort);
+        m_dlnaServer.presentationURL.push_back(x_ps_strdup(presentationURL));
+        m_dlnaServer.udn.push_back(x_ps_strdup(udn));
+        m_dlnaServer.expires.push_back(millis() + SSDP_DEFAULT_MAX_AGE * 1000);
+        m_dlnaServer.size++;
+        rebuildServerIndex();
+    }
+    free(blob);
+    for(uint8_t i = 0; i < m_dlnaServer.size; i++){
+        cbServer(i);
+    }
+
+    // ask every cached server directly if it is still there
+    m_verified = 0;
+    m_probing = 0;
+    if(m_dlnaServer.size && WiFi.status() == WL_CONNECTED && m_udp.begin(m_ssdpPort)){
+        for(uint8_t i = 0; i < m_dlnaServer.size; i++) sendMSearch(m_dlnaServer.ip[i]);
+        m_ssdpSent = 1;
+        m_verifyActive = true;
+        m_timeStamp = millis();
+    }
+    return m_dlnaServer.size;
+}
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool DLNA_Client::srvGet(uint8_t srvNr){
-    bool ret = false;
-    m_client.stop();
-    m_client.setTimeout(CONNECT_TIMEOUT);
-    uint32_t t = millis();
-    ret = m_client.connect(m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr]);
-    if(!ret){
-        m_client.stop();
-        sprintf(m_chbuf, "The server %s:%d did not answer within %lums [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], millis() - t, __FILENAME__, __LINE__);
-        if(dlna_info) dlna_info(m_chbuf);
+void DLNA_Client::finishVerify(){ // servers that did not answer the unicast M-SEARCH get a second chance, their description is read again
+    m_udp.stop();
+    m_verifyActive = false;
+    for(uint8_t i = 0; i < m_dlnaServer.size; i++){
+        if(m_verified & (1UL << i)) continue;
+        free(m_dlnaServer.controlURL[i]);
+        m_dlnaServer.controlURL[i] = x_ps_strdup("?");
+        m_probing |= (1UL << i);
+    }
+    if(m_probing || m_resolvePending) {m_resolvePending = true; m_seekActive = true;} // dlna_seekReady() after GET_SERVER_ITEMS
+    else cbSeekReady();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::clearServerCache(){
+    Preferences prefs;
+    if(prefs.begin(DLNA_CACHE_NAMESPACE, false)) prefs.remove("server");
+    prefs.end();
+    m_cacheEnabled = false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::enableNotifyListener(bool enable){
+    if(!enable){
+        if(m_notifyEnabled) m_udpNotify.stop();
+        m_notifyEnabled = false;
+        return true;
+    }
+    if(m_notifyEnabled) return true;
+    if(WiFi.status() != WL_CONNECTED) return false; // guard
+    chbuf_alloc();
+    if(!m_udpNotify.beginMulticast(IPAddress(SSDP_MULTICAST_IP), SSDP_MULTICAST_PORT)){
+        m_udpNotify.stop(); log_e("can't join the SSDP multicast group");
         return false;
     }
-    t = millis() + 250;
-    while(true){
-        if(m_client.connected()) break;
-        if(t < millis()){
-            sprintf(m_chbuf, "The server %s:%d refuses the connection [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], __FILENAME__, __LINE__);
-            if(dlna_info) dlna_info(m_chbuf);
-            return false;
+    m_notifyEnabled = true;
+    m_expiryCheck = millis();
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int DLNA_Client::tcpConnectStart(const char* ip, uint16_t port){ // non-blocking connect, returns the socket or -1
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(fd < 0) {log_e("no free socket"); return -1;}
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip);
+    int res = connect(fd, (struct sockaddr*)&addr, sizeof(addr));
+    if(res < 0 && errno != EINPROGRESS) {close(fd); return -1;}
+    return fd;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::tcpConnectPoll(int fd){ // 1: connected, 0: in progress, -1: refused
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(fd, &fdset);
+    struct timeval tv = {0, 0};
+    int res = select(fd + 1, NULL, &fdset, NULL, &tv);
+    if(res < 0) return -1;
+    if(res == 0) return 0;
+    int sockerr = 0;
+    socklen_t len = sizeof(sockerr);
+    if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &sockerr, &len) < 0 || sockerr) return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & (~O_NONBLOCK)); // WiFiClient expects a blocking socket
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return 1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::fetchStart(descFetch_t& f, uint8_t srvNr){
+    f.fd = tcpConnectStart(m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr]);
+    if(f.fd < 0) return false;
+    if(f.state == FETCH_IDLE) {f.attempt = 0; f.start = millis();} // not a retry
+    f.srvNr = srvNr;
+    f.state = FETCH_CONNECT;
+    f.timeStamp = millis();
+    f.lineLen = 0;
+    f.headerDone = false;
+    f.statusOk = false;
+    f.chunked = false;
+    f.keepAlive = true;
+    f.contentLength = HTTP_LENGTH_UNKNOWN;
+    f.cdService = false;
+    f.serviceType[0] = '\0';
+    f.friendlyName[0] = '\0';
+    f.controlURL[0] = '\0';
+    f.presentationURL[0] = '\0';
+    xmlInit(f.tok, XML_DESC, &f);
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::fetchPoll(descFetch_t& f){
+    if(f.state == FETCH_CONNECT){
+        int8_t res = tcpConnectPoll(f.fd);
+        if(res == 0){
+            if(millis() - f.timeStamp < CONNECT_TIMEOUT) return;
+            sprintf(m_chbuf, "The server %s:%d did not answer within %lums [%s:%d]", m_dlnaServer.ip[f.srvNr], m_dlnaServer.port[f.srvNr], (long unsigned int)(millis() - f.timeStamp), __FILENAME__, __LINE__);
+            cbInfo(m_chbuf);
+            close(f.fd); f.fd = -1;
+            fetchDone(f, false);
+            return;
+        }
+        if(res < 0){
+            sprintf(m_chbuf, "The server %s:%d refuses the connection [%s:%d]", m_dlnaServer.ip[f.srvNr], m_dlnaServer.port[f.srvNr], __FILENAME__, __LINE__);
+            cbInfo(m_chbuf);
+            close(f.fd); f.fd = -1;
+            fetchDone(f, false);
+            return;
         }
+        f.client = WiFiClient(f.fd); // WiFiClient owns the socket now
+        f.fd = -1;
+        char* req = x_ps_malloc(strlen(m_dlnaServer.location[f.srvNr]) + 120);
+        sprintf(req, "GET /%s HTTP/1.1\r\nHost: %s:%d\r\nConnection: keep-alive\r\nUser-Agent: ESP32/Player/UPNP1.0\r\n\r\n",
+                     m_dlnaServer.location[f.srvNr], m_dlnaServer.ip[f.srvNr], m_dlnaServer.port[f.srvNr]);
+        f.client.print(req);
+        free(req);
+        f.state = FETCH_RECEIVE;
+        f.timeStamp = millis();
+        return;
     }
-    // assemble HTTP header
-    sprintf(m_chbuf, "GET /%s HTTP/1.1\r\nHost: %s:%d\r\nConnection: close\r\nUser-Agent: ESP32/Player/UPNP1.0\r\n\r\n",
-                      m_dlnaServer.location[srvNr], m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr]);
-    m_client.print(m_chbuf);
-    t = millis() + AVAIL_TIMEOUT;
-    while(true){
-        if(m_client.available()) break;
-        if(t < millis()){
-            sprintf(m_chbuf, "The server %s:%d is not responding after request [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], __FILENAME__, __LINE__);
-            if(dlna_info) dlna_info(m_chbuf);
-            return false;
+    if(f.state == FETCH_RECEIVE){
+        char buf[256];
+        while(f.client.available() > 0){
+            int n = f.client.read((uint8_t*)buf, sizeof(buf));
+            if(n <= 0) break;
+            f.timeStamp = millis();
+            int i = 0;
+            while(!f.headerDone && i < n){ // response header, line by line
+                char c = buf[i++];
+                if(c == '\r') continue;
+                if(c != '\n') {if(f.lineLen < sizeof(f.line) - 1) f.line[f.lineLen++] = c; continue;}
+                f.line[f.lineLen] = '\0';
+                if(f.lineLen == 0) {f.headerDone = true; bodyInit(f.body, f.chunked, f.contentLength); break;} // empty line, end of header
+                if(startsWith(f.line, "HTTP/1.")) {f.statusOk = (strstr(f.line, " 200") != NULL); f.keepAlive = (f.line[7] == '1');}
+                else if(strncasecmp(f.line, "connection:", 11) == 0) f.keepAlive = (strcasestr(f.line + 11, "keep-alive") != NULL);
+                else if(strncasecmp(f.line, "content-length:", 15) == 0) f.contentLength = atol(f.line + 15);
+                else if(strncasecmp(f.line, "transfer-encoding:", 18) == 0) f.chunked = (strcasestr(f.line + 18, "chunked") != NULL);
+                f.lineLen = 0;
+            }
+            if(i < n){ // body, straight into the tokenizer
+                int32_t len = bodyDecode(f.body, buf + i, n - i);
+                if(f.body.state == BODY_ERROR) {fetchDone(f, false); return;}
+                xmlParse(f.tok, buf + i, len);
+            }
+            if(f.headerDone && f.body.state == BODY_DONE) {fetchDone(f, true); return;}
         }
+        if(!f.client.connected()){ // EOF is the end of a body without Content-Length
+            fetchDone(f, f.headerDone && !f.chunked && f.contentLength == HTTP_LENGTH_UNKNOWN);
+            return;
+        }
+        if(millis() - f.timeStamp > READ_TIMEOUT){
+            sprintf(m_chbuf, "The server %s:%d is not responding after request [%s:%d]", m_dlnaServer.ip[f.srvNr], m_dlnaServer.port[f.srvNr], __FILENAME__, __LINE__);
+            cbInfo(m_chbuf);
+            fetchDone(f, false);
+        }
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::fetchDone(descFetch_t& f, bool ok){
+    if(ok && f.keepAlive && f.body.state == BODY_DONE && !f.body.surplus) connPark(m_dlnaServer.ip[f.srvNr], m_dlnaServer.port[f.srvNr], f.client); // the first Browse needs no connect
+    f.client.stop();
+    if(ok) ok = f.statusOk && getServerItems(f);
+    if(!ok){
+        f.attempt++;
+        if(f.attempt < FETCH_ATTEMPTS && millis() - f.start < CONNECT_TIMEOUT){ // retry, but a dead server must not delay the others
+            if(fetchStart(f, f.srvNr)) return;
+        }
+        log_e("no response from svr [%i]", f.srvNr);
+    }
+    f.state = FETCH_IDLE;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::fetchAbort(descFetch_t& f){ // the download is dropped, the socket is closed
+    if(f.fd >= 0) {close(f.fd); f.fd = -1;}
+    f.client.stop();
+    f.state = FETCH_IDLE;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::fetchServerItems(){ // read all descriptions at the same time, returns true if all are done
+    bool busy = false;
+    for(uint8_t i = 0; i < DLNA_MAX_FETCH; i++){
+        descFetch_t& f = m_fetch[i];
+        while(f.state == FETCH_IDLE && m_fetchNext < m_dlnaServer.size){
+            uint8_t srvNr = m_fetchNext++;
+            if(strcmp(m_dlnaServer.controlURL[srvNr], "?") != 0) continue; // already known
+            if(!fetchStart(f, srvNr)) log_e("can't connect to svr [%i]", srvNr);
+        }
+        if(f.state != FETCH_IDLE) {fetchPoll(f); busy = true;}
+    }
+    return !busy && m_fetchNext >= m_dlnaServer.size;
+}
+
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::connOpen(WiFiClient& client, uint8_t srvNr, bool& reused){ // take an idle keep-alive connection to this server or connect
+
+    reused = connTake(client, srvNr);
+    if(reused) return true;
+    client.stop();
+    uint32_t t = millis();
+    int fd = tcpConnectStart(m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr]);
+    int8_t r = (fd < 0) ? -1 : 0;
+    while(r == 0 && millis() - t < CONNECT_TIMEOUT){
+        r = tcpConnectPoll(fd);
+        if(r == 0) vTaskDelay(1);
+    }
+    if(r <= 0){
+        if(fd >= 0) close(fd);
+        sprintf(m_chbuf, "The server %s:%d is not responding after %lums [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], (long unsigned int)(millis() - t), __FILENAME__, __LINE__);
+        cbInfo(m_chbuf);
+        return false;
     }
+    client = WiFiClient(fd); // WiFiClient owns the socket now
     return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool DLNA_Client::readHttpHeader(){
+bool DLNA_Client::connTake(WiFiClient& client, uint8_t srvNr){ // an idle keep-alive connection to this server, the stale ones are closed
+
+    bool taken = false;
+    for(uint8_t i = 0; i < DLNA_MAX_CONN; i++){
+        httpConn_t& c = m_conn[i];
+        if(c.port != m_dlnaServer.port[srvNr] || strcmp(c.ip, m_dlnaServer.ip[srvNr]) != 0) continue;
+        bool fresh = millis() - c.lastUse < KEEP_ALIVE_IDLE;
+        if(fresh && c.client.connected() && !c.client.available()){ // unread data would belong to an unknown response
+            client = c.client;
+            taken = true;
+        }
+        c.client.stop();
+        c.port = 0;
+        if(taken) return true;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::connIdle(uint8_t srvNr){ // true if connTake() would find a keep-alive connection, no connect needed
+    for(uint8_t i = 0; i < DLNA_MAX_CONN; i++){
+        httpConn_t& c = m_conn[i];
+        if(c.port != m_dlnaServer.port[srvNr] || strcmp(c.ip, m_dlnaServer.ip[srvNr]) != 0) continue;
+        if(millis() - c.lastUse < KEEP_ALIVE_IDLE && c.client.connected() && !c.client.available()) return true;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::connPark(const char* ip, uint16_t port, WiFiClient& client){ // keep the connection for the next request, the oldest one is closed
 
-    bool ct_seen = false;
+    uint8_t slot = 0;
+    for(uint8_t i = 0; i < DLNA_MAX_CONN; i++){
+        if(!m_conn[i].port) {slot = i; break;}
+        if(m_conn[i].lastUse < m_conn[slot].lastUse) slot = i;
+    }
+    httpConn_t& c = m_conn[slot];
+    c.client = client; // WiFiClient shares the socket
+    client.stop();
+    strncpy(c.ip, ip, sizeof(c.ip) - 1);
+    c.ip[sizeof(c.ip) - 1] = '\0';
+    c.port = port;
+    c.lastUse = millis();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::readHttpHeader(){
+    if(!headerStart()) return false;
+    return headerStep(false) > 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::headerStart(){
+    if(!rx_alloc()) return false;
     m_timeStamp  = millis();
-    uint16_t rhlSize = 1024;
-    char* rhl = x_ps_malloc(rhlSize); // response header line
+    m_contentlength = HTTP_LENGTH_UNKNOWN;
+    m_chunked = false;
+    m_keepAlive = true; // HTTP/1.1 default
+    m_httpStatus = 0;
+    m_hdrLen = 0;
+    m_hdrCtSeen = false;
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::headerStep(bool sliced){ // 1: done, -1: error, 0: sliced and the rest of the header is not there yet, call again
+
     while(true){  // outer while
-        uint16_t pos = 0;
+        if(m_cancel && !m_crawlRun) return -1; // cancelRequest()
         if((m_timeStamp + READ_TIMEOUT) < millis()) {
             sprintf(m_chbuf, "timeout in readHttpHeader [%s:%d]", __FILENAME__, __LINE__);
-            if(dlna_info) dlna_info(m_chbuf);
-            goto error;
+            cbInfo(m_chbuf);
+            return -1;
         }
-        while(m_client.available()) {
-            uint8_t b = m_client.read();
+        if(!rxFill(RX_BUF_SIZE)){
+            if(!m_client.connected()) return -1;
+            if(sliced) return 0;
+            vTaskDelay(1); // wait for the next segment
+            continue;
+        }
+        bool eol = false;
+        while(rx_used()) { // the header is parsed in the receive buffer, the body that follows stays there
+            uint8_t b = rx_get();
             if(b == '\n') {
-                if(!pos) {  // empty line received, is the last line of this responseHeader
+                if(!m_hdrLen) {  // empty line received, is the last line of this responseHeader
                     goto exit;
                 }
+                eol = true;
                 break;
             }
-            if(b == '\r') rhl[pos] = 0;
             if(b < 0x20) continue;
-            rhl[pos] = b;
-            pos++;
-            if(pos == rhlSize -1) {
-                pos--;
-                continue;
-            }
-            if(pos == rhlSize - 2) {
-                rhl[pos] = '\0';
-                sprintf(m_chbuf, "responseHeaderline overflow, response was: %s", rhl);
-                if(dlna_info) dlna_info(m_chbuf);
-            }
+            if(m_hdrLen < sizeof(m_hdrLine) - 1) m_hdrLine[m_hdrLen++] = b; // the rest of a long line is not needed
         } // inner while
+        if(!eol) continue; // the rest of the line is still on the way
+        char* rhl = m_hdrLine; // response header line
+        rhl[m_hdrLen] = '\0';
+        m_hdrLen = 0;
     //    log_w("%s", rhl);
         int16_t posColon = indexOf(rhl, ":", 0);  // lowercase all letters up to the colon
         if(posColon >= 0) {
             for(int i = 0; i < posColon; i++) { rhl[i] = toLowerCase(rhl[i]); }
         }
-        if(startsWith(rhl, "content-length:")){
+        if(startsWith(rhl, "HTTP/1.")){ // HTTP/1.1 200 OK
+            const char* p = strchr(rhl, ' ');
+            m_httpStatus = p ? atoi(p + 1) : 0;
+            if(rhl[7] == '0') m_keepAlive = false;
+        }
+        else if(startsWith(rhl, "connection:")){
+            m_keepAlive = (strcasestr(rhl + 11, "keep-alive") != NULL);
+        }
+        else if(startsWith(rhl, "content-length:")){
             const char* c_cl = (rhl + 15);
             int32_t     i_cl = atoi(c_cl);
             m_contentlength = i_cl;
@@ -220,11 +791,11 @@ bool DLNA_Client::readHttpHeader(){
         else if(startsWith(rhl, "content-type:")) {  // content-type: text/html; charset=UTF-8
             int idx = indexOf(rhl + 13, ";", 0);
             if(idx > 0) rhl[13 + idx] = '\0';
-            if(indexOf(rhl + 13, "text/xml", 0) > 0) ct_seen = true;
-            else if(indexOf(rhl + 13, "text/html", 0) > 0) ct_seen = true;
+            if(indexOf(rhl + 13, "text/xml", 0) > 0) m_hdrCtSeen = true;
+            else if(indexOf(rhl + 13, "text/html", 0) > 0) m_hdrCtSeen = true;
             else{
                 sprintf(m_chbuf, "content type expected: text/xml or text/html, got %s", rhl + 13);
-                if(dlna_info) dlna_info(m_chbuf);
+                cbInfo(m_chbuf);
                 goto exit; // wrong content type
             }
         }
@@ -238,142 +809,207 @@ bool DLNA_Client::readHttpHeader(){
     } // outer while
 
 exit:
-    if(rhl) {free(rhl); rhl = NULL;}
-    if(!m_contentlength) log_e("contentlength is not given");
-    if(!ct_seen) log_e("content type not found");
-    return true;
-
-error:
-    if(rhl) {free(rhl); rhl = NULL;}
+    if(m_contentlength == HTTP_LENGTH_UNKNOWN && !m_chunked) log_e("contentlength is not given");
+    if(!m_hdrCtSeen) log_e("content type not found");
+    return 1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::readContent(){ // the body goes straight into the tokenizer, items are reported while they arrive
+    contentStart();
+    bool res = bodyStep(false) > 0;
+    contentEnd();
+    return res && statusOk(m_srvNr);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::statusOk(uint8_t srvNr){ // a Browse or Search response counts only with status 200, a SOAP fault comes with 500
+    if(m_httpStatus == 200) return true;
+    sprintf(m_chbuf, "The server %s:%d answered with HTTP status %u [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], m_httpStatus, __FILENAME__, __LINE__);
+    cbInfo(m_chbuf);
     return false;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool DLNA_Client::readContent(){
-
+void DLNA_Client::contentStart(){
+    m_numberReturned = 0;
+    m_totalMatches = 0;
+    srvContent_clear();
+    srvContent_reserve(m_maxCount);
+    bodyStart();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::contentEnd(){
+    cbItems(); // the rest of the page
+    if(m_storeFull){
+        sprintf(m_chbuf, "memory limit %lu reached, %u items reported but not stored [%s:%d]", (long unsigned int)m_memLimit, m_storeSkipped, __FILENAME__, __LINE__);
+        cbInfo(m_chbuf);
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::readBody(){ // SOAP response -> soapEvent()
+    bodyStart();
+    return bodyStep(false) > 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::bodyStart(){
     m_timeStamp  = millis();
-    uint32_t idx = 0;
-    uint8_t lastChar = 0;
-    uint8_t b = 0;
-    bool f_overflow = false;
-    vector_clear_and_shrink(m_content);
+    m_updateId = 0;
+    m_updateIdSeen = false;
+    xmlInit(m_soapTok, XML_SOAP);
+    bodyInit(m_body, m_chunked, m_contentlength);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::bodyStep(bool sliced){ // 1: done, -1: error, 0: sliced and the budget is used up or no data is there, call again
 
-    while(true){  // outer while
-        uint16_t pos = 0;
-        uint8_t cnt = 0;
+    uint32_t bytes = 0;
+    while(m_body.state != BODY_DONE){
+        if(m_cancel && !m_crawlRun) return -1; // cancelRequest()
         if((m_timeStamp + READ_TIMEOUT) < millis()) {
-            sprintf(m_chbuf, "timeout in readContent [%s:%d]", __FILENAME__, __LINE__);
-            if(dlna_info) dlna_info(m_chbuf);
-            goto error;
-        }
-        while(m_client.available()) {
-            if(lastChar){
-                b = lastChar;
-                lastChar = 0;
-            }
-            else{
-                b = m_client.read();
-                idx++;
-            }
-            if(b == '\n') {
-                m_chbuf[pos] = '\0';
-                break;
-            }
-            if(b == '<' &&  m_chbuf[pos - 1] == '>'){
-                lastChar = '<';
-                m_chbuf[pos] = '\0';
-                break; // simulate new line
-            }
-            if(b == ';'){
-                m_chbuf[pos] = '\0';
-                break; // simulate new line
-            }
-            if(b == '\r') m_chbuf[pos] = '\0';
-            if(b < 0x20) continue;
-            m_chbuf[pos] = b;
-            pos++;
-            if(pos >= m_chbufSize -1) {
-                m_chbuf[pos] = '\0';
-                f_overflow = true;
-                pos--;
+            sprintf(m_chbuf, "timeout in readBody [%s:%d]", __FILENAME__, __LINE__);
+            cbInfo(m_chbuf);
+            return -1;
+        }
+        if(!rx_used()){ // the first part of the body may already be there, see headerStep()
+            if(!rxFill(body_want(m_body, RX_BUF_SIZE))){
+                if(!m_client.connected()) break;
+                if(sliced) return 0;
+                vTaskDelay(1); // wait for the next segment
                 continue;
             }
-            while(!m_client.available()){
-                vTaskDelay(10);
-                cnt++;
-                if(cnt == 100){sprintf(m_chbuf, "timeout in readContent [%s:%d]", __FILENAME__, __LINE__); break;}
-            }
+            m_timeStamp = millis();
+        }
+        uint32_t off = m_rxTail & (RX_BUF_SIZE - 1);
+        int32_t n = rx_used();
+        if(n > (int32_t)(RX_BUF_SIZE - off)) n = RX_BUF_SIZE - off; // up to the end of the ring
+        if(sliced && n > 1024) n = 1024;                              // the budget is checked after each piece
+        if(sliced && m_loopBytes && n > (int32_t)(m_loopBytes - bytes)) n = m_loopBytes - bytes;
+        m_rxTail += n;
+        bytes += n;
+        n = bodyDecode(m_body, m_rxBuf + off, n); // in place
+        if(m_body.state == BODY_ERROR){
+            sprintf(m_chbuf, "invalid chunk size in readBody [%s:%d]", __FILENAME__, __LINE__);
+            cbInfo(m_chbuf);
+            return -1;
         }
-        if(f_overflow)log_e("line overflow");
+        xmlParse(m_soapTok, m_rxBuf + off, n);
+        if(sliced && m_body.state != BODY_DONE && budgetUsed(bytes)) return 0;
+    }
+    if(m_body.state != BODY_DONE && (m_body.chunked || m_contentlength != HTTP_LENGTH_UNKNOWN)){ // closed before the end of the body
+        sprintf(m_chbuf, "the server closed the connection, the response is truncated [%s:%d]", __FILENAME__, __LINE__);
+        cbInfo(m_chbuf);
+        return -1;
+    }
+    return 1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::bodyInit(httpBody_t& b, bool chunked, uint32_t contentLength){
+    b.chunked = chunked;
+    b.remaining = chunked ? 0 : contentLength;
+    b.lineLen = 0;
+    b.surplus = 0;
+    b.state = (!chunked && contentLength == 0) ? BODY_DONE : (chunked ? BODY_SIZE : BODY_DATA);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int32_t DLNA_Client::bodyDecode(httpBody_t& b, char* buf, int32_t len){ // removes the chunk framing in place, returns the number of payload bytes in buf
 
-//        log_w("%s %i", m_chbuf, m_content.size());
-        m_content.push_back(x_ps_strdup(m_chbuf));
-        if(!m_chunked &&  idx == m_contentlength) break;
-        if(!m_client.available()){
-            vTaskDelay(10);
-               if(m_chunked == true) break; // ok
-        //    if(m_contentlength)   break; // ok
-        //    goto error; // not ok
+    if(!b.chunked){
+        if(b.remaining == HTTP_LENGTH_UNKNOWN) return len; // until the server closes the connection
+        if((uint32_t)len > b.remaining) {b.surplus += len - b.remaining; len = b.remaining;}
+        b.remaining -= len;
+        if(!b.remaining) b.state = BODY_DONE;
+        return len;
+    }
+    int32_t out = 0;
+    for(int32_t i = 0; i < len && b.state < BODY_DONE; i++){
+        char c = buf[i];
+        switch(b.state){
+            case BODY_SIZE: // chunk size in hex
+                if(isxdigit(c)){
+                    if(b.remaining > 0x0FFFFFFF) {b.state = BODY_ERROR; break;}
+                    b.remaining = (b.remaining << 4) | (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+                    b.lineLen = 1; // a digit has come
+                    break;
+                }
+                if(!b.lineLen) {b.state = BODY_ERROR; break;} // empty or no hex number, corrupt framing
+                b.state = BODY_EXT;
+                /* fall through */
+            case BODY_EXT: // chunk extensions are ignored
+                if(c != '\n') break;
+                b.lineLen = 0;
+                b.state = b.remaining ? BODY_DATA : BODY_TRAILER; // 0: last chunk
+                break;
+            case BODY_DATA: {
+                uint32_t n = len - i;
+                if(n > b.remaining) n = b.remaining;
+                memmove(buf + out, buf + i, n);
+                out += n;
+                i += n - 1;
+                b.remaining -= n;
+                if(!b.remaining) b.state = BODY_DATA_END;
+                break;
+            }
+            case BODY_DATA_END: // CRLF behind the chunk data
+                if(c == '\n') {b.state = BODY_SIZE; b.lineLen = 0;}
+                break;
+            case BODY_TRAILER: // trailer fields up to the empty line
+                if(c == '\n') {if(!b.lineLen) {b.state = BODY_DONE; b.surplus += len - i - 1;} b.lineLen = 0;}
+                else if(c != '\r' && b.lineLen < 255) b.lineLen++;
+                break;
         }
-        m_timeStamp  = millis();
     }
-    return true;
+    return out;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::rxFill(uint32_t maxLen){ // one large read into the free part of the ring, returns the bytes in the ring
 
-error:
-    return false;
+    uint32_t used = rx_used();
+    uint32_t space = RX_BUF_SIZE - used;
+    if(space > maxLen) space = maxLen;
+    if(!space) return used;
+    int32_t av = m_client.available();
+    if(av <= 0) return used;
+    uint32_t off = m_rxHead & (RX_BUF_SIZE - 1);
+    uint32_t n = RX_BUF_SIZE - off; // up to the end of the ring, the rest with the next call
+    if(n > space) n = space;
+    if(n > (uint32_t)av) n = av;
+    int32_t res = m_client.read((uint8_t*)m_rxBuf + off, n);
+    if(res > 0) m_rxHead += res;
+    return rx_used();
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool DLNA_Client::getServerItems(uint8_t srvNr){
+bool DLNA_Client::getServerItems(descFetch_t& f){ // the description has been parsed by descEvent()
     if(m_dlnaServer.size == 0) return 0;  // return if none detected
+    uint8_t srvNr = f.srvNr;
 
+    if(f.tok.elem[0] == '\0') return false; // no XML received
+    free(m_dlnaServer.friendlyName[srvNr]);
+    if(strlen(f.friendlyName) == 0){
+        m_dlnaServer.friendlyName[srvNr] = x_ps_strdup("Server name not provided");
+    }
+    else{
+        m_dlnaServer.friendlyName[srvNr] = x_ps_strdup(f.friendlyName);
+    }
 
-    bool gotFriendlyName = false;
-    bool gotServiceType  = false;
-    bool URNschemaFound  = false;
-
-    for(int i = 0; i < m_content.size(); i++){
-        uint16_t idx = 0;
-        while(*(m_content[i] + idx) == 0x20) idx++;  // same as trim left
-        char* content = m_content[i] + idx;
-        if(!gotFriendlyName) {
-            if(startsWith(content, "<friendlyName>")){
-                uint16_t pos = indexOf(content, "<", 14);
-                *(content + pos) = '\0';
-                if(strlen(content) == 0){
-                    m_dlnaServer.friendlyName[srvNr] = (char*)"Server name not provided";
-                }
-                else{
-                    m_dlnaServer.friendlyName[srvNr] = x_ps_strdup(content + 14);
-                }
-                gotFriendlyName = true;
-            }
-        }
-        if(!gotServiceType) {
-            if(indexOf(content, "urn:schemas-upnp-org:service:ContentDirectory:1", 0) > 0){URNschemaFound = true; continue;}
-            if(URNschemaFound){
-                if(startsWith(content, "<controlURL>")){
-                    uint16_t pos = indexOf(content, "<", 12);
-                    *(content + pos) = '\0';
-                    m_dlnaServer.controlURL[srvNr] = x_ps_strdup(content + 13);
-                    gotServiceType = true;
-                }
-            }
-        }
-        if(startsWith(content, "<presentationURL>")){
-            uint16_t pos = indexOf(content, "<", 17);
-            *(content + pos) = '\0';
-            char* presentationURL = x_ps_strdup(content + 17);
-            if(!startsWith(presentationURL, "http://")) continue;
-            int8_t posColon = (indexOf(presentationURL, ":", 8));
-            if(posColon > 0){ // we have ip and port
-                presentationURL[posColon] = '\0';
-                m_dlnaServer.presentationURL[srvNr] = x_ps_strdup(presentationURL + 7); // add presentationURL(IP)
-                m_dlnaServer.presentationPort[srvNr] = atoi(presentationURL + posColon + 1);
-            } // only ip is given
-            else{
-                m_dlnaServer.presentationURL[srvNr] = x_ps_strdup(presentationURL + 7);
-            }
-            if(presentationURL){free(presentationURL); presentationURL = NULL;}
-        }
+    if(f.controlURL[0]){
+        const char* p = f.controlURL;
+        while(*p == ' ') p++;
+        if(*p == '/') p++;
+        free(m_dlnaServer.controlURL[srvNr]);
+        m_dlnaServer.controlURL[srvNr] = x_ps_strdup(p);
+    }
+
+    if(startsWith(f.presentationURL, "http://")){
+        char* presentationURL = f.presentationURL;
+        char* q = strchr(presentationURL + 7, '/'); if(q) *q = '\0';
+        int8_t posColon = (indexOf(presentationURL, ":", 8));
+        if(posColon > 0){ // we have ip and port
+            presentationURL[posColon] = '\0';
+            free(m_dlnaServer.presentationURL[srvNr]);
+            m_dlnaServer.presentationURL[srvNr] = x_ps_strdup(presentationURL + 7); // add presentationURL(IP)
+            m_dlnaServer.presentationPort[srvNr] = atoi(presentationURL + posColon + 1);
+        } // only ip is given
+        else{
+            free(m_dlnaServer.presentationURL[srvNr]);
+            m_dlnaServer.presentationURL[srvNr] = x_ps_strdup(presentationURL + 7);
+        }
     }
 
     // we finally got all infos we need
@@ -388,361 +1024,1412 @@ bool DLNA_Client::getServerItems(uint8_t srvNr){
     }
     if(m_dlnaServer.controlURL[srvNr] && startsWith(m_dlnaServer.controlURL[srvNr], "http://")) { // remove "http://ip:port/" from begin of string
         idx = indexOf(m_dlnaServer.controlURL[srvNr], "/", 7);
-        memcpy(m_dlnaServer.controlURL[srvNr], m_dlnaServer.controlURL[srvNr] + idx + 1, strlen(m_dlnaServer.controlURL[srvNr]) + idx + 2);
+        memmove(m_dlnaServer.controlURL[srvNr], m_dlnaServer.controlURL[srvNr] + idx + 1, strlen(m_dlnaServer.controlURL[srvNr] + idx + 1) + 1);
     }
     if(strcmp(m_dlnaServer.friendlyName[srvNr], "?") == 0){log_e("friendlyName %s, [%i]", m_dlnaServer.friendlyName[srvNr], srvNr); return false;}
     if(strcmp(m_dlnaServer.controlURL[srvNr], "?") == 0){log_e("controlURL %s, [%i]", m_dlnaServer.controlURL[srvNr], srvNr); return false;}
-    if(dlna_server) dlna_server(srvNr, m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], m_dlnaServer.friendlyName[srvNr],m_dlnaServer.controlURL[srvNr]);
+    cbServer(srvNr);
     return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool DLNA_Client::browseResult(){
-
-    auto makeContentPushBack = [&](){ // lambda, inner function
-        char* dummy1 = strdup("?");
-        char* dummy2 = strdup("?");
-        char* dummy3 = strdup("?");
-        char* dummy4 = strdup("?");
-        char* dummy5 = strdup("?");
-        DLNA_Client::m_srvContent.childCount.push_back(0);
-        DLNA_Client::m_srvContent.isAudio.push_back(0);
-        DLNA_Client::m_srvContent.itemSize.push_back(0);
-        DLNA_Client::m_srvContent.itemURL.push_back(dummy1);
-        DLNA_Client::m_srvContent.duration.push_back(dummy2);
-        DLNA_Client::m_srvContent.objectId.push_back(dummy3);
-        DLNA_Client::m_srvContent.parentId.push_back(dummy4);
-        DLNA_Client::m_srvContent.title.push_back(dummy5);
-        DLNA_Client::m_srvContent.size++;
-    };
-
-    m_numberReturned = 0;
-    m_totalMatches = 0;
-    bool item1 = false;
-    bool item2 = false;
-    int a, b, c, d;
-    srvContent_clear_and_shrink();
-    for(int i = 0; i < m_content.size(); i++){
-        uint16_t idx = 0;
-        while(*(m_content[i] + idx) == 0x20) idx++;  // same as trim left
-        char* content = m_content[i] + idx;
-        // log_i("%s", content);
-        /*------C O N T A I N E R -------*/
-        if(startsWith(content, "container id")) {item1 = true; memset(m_chbuf, 0, m_chbufSize);}
-        if(item1){
-            strcat(m_chbuf, content);
-        }
-        if(startsWith(content, "/container")) {
-        //    log_i("%s", m_chbuf);
-            item1 = false;
-            uint16_t cNr = m_srvContent.size;
-            makeContentPushBack();
-            replacestr(m_chbuf, "&quot", "\"");
-            replacestr(m_chbuf, "&ampamp", "&");   // ampersand
-            replacestr(m_chbuf, "&ampapos", "'");  // apostrophe
-            replacestr(m_chbuf, "&ampquot", "\""); // quotation
-
-            a = indexOf(m_chbuf, "container id=", 0);
-            if(a >= 0) {
-                a += 14;
-                b = indexOf(m_chbuf, "\"", a);
-                m_srvContent.objectId[cNr] = x_ps_strndup(m_chbuf + a, b - a);
-            }
-
-            a = indexOf(m_chbuf, "parentID=", 0);
-            if(a >= 0) {
-                a += 10;
-                b = indexOf(m_chbuf, "\"", a);
-                m_srvContent.parentId[cNr] = x_ps_strndup(m_chbuf + a, b - a);
+void DLNA_Client::xmlInit(xmlTok_t& t, uint8_t type, void* ctx){
+    t.type = type;
+    t.state = 0;
+    t.endTag = false;
+    t.emptyTag = false;
+    t.elem[0] = '\0';
+    t.nameLen = 0;
+    t.entLen = 0;
+    t.match = 0;
+    t.sink = NULL;
+    t.cut = false;
+    t.text = NULL;
+    t.pipe = NULL;
+    t.ctx = ctx;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::xmlPut(xmlTok_t& t, char c){ // one character of text or attribute value
+    if(t.pipe) {xmlParse(*t.pipe, &c, 1); return;}
+    if(!t.sink) return;
+    if(t.sinkLen >= t.sinkSize - 1) {t.cut = true; return;} // full, the handler decides at the end of the value
+    t.sink[t.sinkLen++] = c;
+    t.sink[t.sinkLen] = '\0';
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::xmlEvent(xmlTok_t& t, uint8_t ev){
+    if(ev != XML_ATTR_END) t.sink = NULL; // the handler sets a new sink if it wants the text or the attribute value
+    switch(t.type){
+        case XML_DESC: descEvent(t, ev); break;
+        case XML_SOAP: soapEvent(t, ev); break;
+        case XML_DIDL: didlEvent(t, ev); break;
+    }
+    switch(ev){
+        case XML_START:    t.text = t.sink; t.textSize = t.sinkSize; break; // the text follows the attributes
+        case XML_END:      t.text = NULL; break;
+        case XML_ATTR_END: t.sink = t.text; t.sinkSize = t.textSize; break;
+    }
+    if(t.sink) {t.sinkLen = 0; t.sink[0] = '\0';}
+    t.cut = false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::xmlPutCodePoint(xmlTok_t& t, const char* num){ // numeric character reference as UTF-8, false if it is not valid
+    char* end;
+    uint32_t cp;
+    if(num[0] == 'x' || num[0] == 'X') cp = strtoul(num + 1, &end, 16);
+    else                               cp = strtoul(num, &end, 10);
+    if(*end || end == num || cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+    if(cp < 0x80) {xmlPut(t, cp); return true;}
+    if(cp < 0x800) {xmlPut(t, 0xC0 | (cp >> 6)); xmlPut(t, 0x80 | (cp & 0x3F)); return true;}
+    if(cp < 0x10000) {xmlPut(t, 0xE0 | (cp >> 12)); xmlPut(t, 0x80 | ((cp >> 6) & 0x3F)); xmlPut(t, 0x80 | (cp & 0x3F)); return true;}
+    xmlPut(t, 0xF0 | (cp >> 18)); xmlPut(t, 0x80 | ((cp >> 12) & 0x3F)); xmlPut(t, 0x80 | ((cp >> 6) & 0x3F)); xmlPut(t, 0x80 | (cp & 0x3F));
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::xmlParse(xmlTok_t& t, const char* buf, uint32_t len){
+    // SAX style, no allocation: xmlEvent() is called for every start tag, attribute and end tag, text and attribute values go into t.sink
+    enum {TEXT, TAG_OPEN, TAG_NAME, ATTRS, ATTR_NAME, ATTR_EQ, ATTR_VAL, BANG, COMMENT, CDATA, DECL, ENTITY};
+    for(uint32_t i = 0; i < len; i++){
+        char c = buf[i];
+        switch(t.state){
+            case TEXT:
+                if(c == '<') {t.state = TAG_OPEN; break;}
+                if(c == '&') {t.entLen = 0; t.entRet = TEXT; t.state = ENTITY; break;}
+                xmlPut(t, c);
+                break;
+            case TAG_OPEN:
+                t.endTag = false;
+                t.emptyTag = false;
+                t.nameLen = 0;
+                if(c == '/') {t.endTag = true; t.state = TAG_NAME; break;}
+                if(c == '!') {t.state = BANG; break;}
+                if(c == '?') {t.state = DECL; break;}
+                t.name[t.nameLen++] = c;
+                t.state = TAG_NAME;
+                break;
+            case TAG_NAME:
+                if(c == '>' || c == '/' || c == ' ' || c == '\t' || c == '\r' || c == '\n'){
+                    t.name[t.nameLen] = '\0';
+                    memcpy(t.elem, t.name, t.nameLen + 1);
+                    if(t.endTag) {if(c == '>') {xmlEvent(t, XML_END); t.state = TEXT;} break;}
+                    xmlEvent(t, XML_START);
+                    if(c == '/') t.emptyTag = true;
+                    if(c == '>') t.state = TEXT;
+                    else t.state = ATTRS;
+                    break;
+                }
+                if(t.nameLen < sizeof(t.name) - 1) t.name[t.nameLen++] = c;
+                break;
+            case ATTRS:
+                if(c == '>') {t.state = TEXT; if(t.emptyTag) xmlEvent(t, XML_END); break;}
+                if(c == '/') {t.emptyTag = true; break;}
+                if(c == ' ' || c == '\t' || c == '\r' || c == '\n') break;
+                t.nameLen = 0;
+                t.name[t.nameLen++] = c;
+                t.state = ATTR_NAME;
+                break;
+            case ATTR_NAME:
+                if(c == '=' || c == ' ') {t.name[t.nameLen] = '\0'; t.state = ATTR_EQ; break;}
+                if(t.nameLen < sizeof(t.name) - 1) t.name[t.nameLen++] = c;
+                break;
+            case ATTR_EQ:
+                if(c == '"' || c == '\''){t.quote = c; t.state = ATTR_VAL; xmlEvent(t, XML_ATTR);}
+                break;
+            case ATTR_VAL:
+                if(c == t.quote) {xmlEvent(t, XML_ATTR_END); t.state = ATTRS; break;}
+                if(c == '&') {t.entLen = 0; t.entRet = ATTR_VAL; t.state = ENTITY; break;}
+                xmlPut(t, c);
+                break;
+            case BANG: // <!-- comment -->, <![CDATA[ text ]]> or <!DOCTYPE >
+                if(c == '-') {t.match = 0; t.state = COMMENT; break;}
+                if(c == '[') {t.nameLen++; if(t.nameLen == 7) {t.match = 0; t.state = CDATA;} break;} // [CDATA[
+                if(c == '>') {t.state = TEXT; break;}
+                if(t.nameLen) t.nameLen++;
+                break;
+            case COMMENT:
+                if(c == '-') {if(t.match < 2) t.match++; break;}
+                if(c == '>' && t.match == 2) {t.state = TEXT; break;}
+                t.match = 0;
+                break;
+            case CDATA:
+                if(c == ']') {if(t.match < 2) t.match++; else xmlPut(t, c); break;}
+                if(c == '>' && t.match == 2) {t.state = TEXT; break;}
+                while(t.match) {xmlPut(t, ']'); t.match--;}
+                xmlPut(t, c);
+                break;
+            case DECL: // <?xml version="1.0"?>
+                if(c == '>') t.state = TEXT;
+                break;
+            case ENTITY:
+                if((isalnum(c) || c == '#') && t.entLen < sizeof(t.ent) - 1) {t.ent[t.entLen++] = c; break;}
+                t.ent[t.entLen] = '\0';
+                t.state = t.entRet;
+                if(c != ';') {xmlPut(t, '&'); for(uint8_t j = 0; j < t.entLen; j++) xmlPut(t, t.ent[j]); i--; break;} // not an entity, c is read again
+                if     (strcmp(t.ent, "lt")   == 0) xmlPut(t, '<');
+                else if(strcmp(t.ent, "gt")   == 0) xmlPut(t, '>');
+                else if(strcmp(t.ent, "amp")  == 0) xmlPut(t, '&');
+                else if(strcmp(t.ent, "quot") == 0) xmlPut(t, '"');
+                else if(strcmp(t.ent, "apos") == 0) xmlPut(t, '\'');
+                else if(t.ent[0] == '#' && xmlPutCodePoint(t, t.ent + 1)) {} // &#233; or &#xE9;
+                else {xmlPut(t, '&'); for(uint8_t j = 0; j < t.entLen; j++) xmlPut(t, t.ent[j]); xmlPut(t, ';');} // unknown, keep it
+                break;
+        }
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::descEvent(xmlTok_t& t, uint8_t ev){ // device description
+    descFetch_t& f = *(descFetch_t*)t.ctx;
+    if(ev == XML_START){
+        if(strcmp(t.elem, "friendlyName") == 0 && !f.friendlyName[0]) {t.sink = f.friendlyName; t.sinkSize = sizeof(f.friendlyName);} // the first is the root device
+        else if(strcmp(t.elem, "serviceType") == 0) {t.sink = f.serviceType; t.sinkSize = sizeof(f.serviceType);}
+        else if(strcmp(t.elem, "controlURL") == 0 && f.cdService && !f.controlURL[0]) {t.sink = f.controlURL; t.sinkSize = sizeof(f.controlURL);}
+        else if(strcmp(t.elem, "presentationURL") == 0 && !f.presentationURL[0]) {t.sink = f.presentationURL; t.sinkSize = sizeof(f.presentationURL);}
+        return;
+    }
+    if(ev == XML_END){
+        if(strcmp(t.elem, "serviceType") == 0) f.cdService = (strstr(f.serviceType, "urn:schemas-upnp-org:service:ContentDirectory:1") != NULL);
+        else if(strcmp(t.elem, "service") == 0) f.cdService = false;
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::soapEvent(xmlTok_t& t, uint8_t ev){ // SOAP envelope of the Browse response
+    const char* name = strchr(t.elem, ':'); // without namespace prefix
+    name = name ? name + 1 : t.elem;
+    if(ev == XML_START){
+        if(strcmp(name, "Result") == 0) {xmlInit(m_didlTok, XML_DIDL); t.pipe = &m_didlTok;}
+        else if(strcmp(name, "NumberReturned") == 0 || strcmp(name, "TotalMatches") == 0) {t.sink = m_soapVal; t.sinkSize = sizeof(m_soapVal);}
+        else if(strcmp(name, "UpdateID") == 0 || strcmp(name, "Id") == 0) {t.sink = m_soapVal; t.sinkSize = sizeof(m_soapVal);} // Browse, GetSystemUpdateID
+        else if(strcmp(name, "SearchCaps") == 0) {t.sink = m_searchCapsBuf; t.sinkSize = sizeof(m_searchCapsBuf);}
+        return;
+    }
+    if(ev == XML_END){
+        if(strcmp(name, "Result") == 0) t.pipe = NULL;
+        else if(strcmp(name, "NumberReturned") == 0) (m_crawlRun ? m_crawlReturned : m_numberReturned) = atoi(m_soapVal); // the crawler leaves the result of the application alone
+        else if(strcmp(name, "TotalMatches") == 0) (m_crawlRun ? m_crawlTotal : m_totalMatches) = atoi(m_soapVal);
+        else if(strcmp(name, "UpdateID") == 0 || strcmp(name, "Id") == 0) {m_updateId = strtoul(m_soapVal, NULL, 10); m_updateIdSeen = true;}
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::didlEvent(xmlTok_t& t, uint8_t ev){ // DIDL-Lite, one <item> or <container> after the other
+    didlItem_t& m = m_item;
+    switch(ev){
+        case XML_START:
+            if(strcmp(t.elem, "item") == 0 || strcmp(t.elem, "container") == 0){
+                memset(&m, 0, sizeof(m));
+                m.isItem = (t.elem[0] == 'i');
             }
-
-            a = indexOf(m_chbuf, "childCount=", 0);
-            if(a >= 0) {
-                a += 12;
-                b = indexOf(m_chbuf, "\"", a);
-                char tmp[10] = {0}; memcpy(tmp, m_chbuf + a, b - a);
-                m_srvContent.childCount[cNr] = atoi(tmp);
+            else if(strcmp(t.elem, "dc:title") == 0) {t.sink = m.title; t.sinkSize = sizeof(m.title);}
+            else if(strcmp(t.elem, "upnp:class") == 0) {t.sink = m.upnpClass; t.sinkSize = sizeof(m.upnpClass);}
+            else if(strcmp(t.elem, "res") == 0 && !m.itemURL[0]) {t.sink = m.itemURL; t.sinkSize = sizeof(m.itemURL);} // the first <res> with a URL
+            break;
+        case XML_ATTR:
+            if(strcmp(t.elem, "item") == 0 || strcmp(t.elem, "container") == 0){
+                if(strcmp(t.name, "id") == 0) {t.sink = m.objectId; t.sinkSize = sizeof(m.objectId);}
+                else if(strcmp(t.name, "parentID") == 0) {t.sink = m.parentId; t.sinkSize = sizeof(m.parentId);}
+                else if(strcmp(t.name, "childCount") == 0) {t.sink = m.childCount; t.sinkSize = sizeof(m.childCount);}
             }
-            a = indexOf(m_chbuf, "dc:title", 0);
-            if(a >= 0) {
-                a += 11;
-                b = indexOf(m_chbuf, "/dc:title", a);
-                b -= 3;
-                m_srvContent.title[cNr] = x_ps_strndup(m_chbuf + a, b - a);
-                if(strlen(m_srvContent.title[cNr]) == 0) m_srvContent.title[cNr] = x_ps_strndup("Unknown\0", 8);
+            else if(strcmp(t.elem, "res") == 0 && !m.itemURL[0]){
+                if(strcmp(t.name, "duration") == 0) {t.sink = m.duration; t.sinkSize = sizeof(m.duration);}
+                else if(strcmp(t.name, "size") == 0) {t.sink = m.itemSize; t.sinkSize = sizeof(m.itemSize);}
             }
+            break;
+        case XML_ATTR_END:
+            if(t.cut && (t.sink == m.objectId || t.sink == m.parentId)) m.idCut = true; // a shortened ID would address another object
+            break;
+        case XML_END:
+            if(strcmp(t.elem, "res") == 0 && t.cut && t.text == m.itemURL) {m.urlCut = true; m.itemURL[0] = '\0';} // no shortened URL, try the next <res>
+            if(strcmp(t.elem, "res") == 0 && !startsWith(m.itemURL, "http")) {m.itemURL[0] = '\0'; m.duration[0] = '\0'; m.itemSize[0] = '\0';} // try the next <res>
+            else if(strcmp(t.elem, "item") == 0 || strcmp(t.elem, "container") == 0) didlItemDone();
+            break;
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::didlItemDone(){ // store the item and report it at once
+    didlItem_t& m = m_item;
+    if(m.idCut || (m.urlCut && !m.itemURL[0])){ // a long title is shortened, an ID or URL can't be
+        snprintf(m_chbuf, m_chbufSize, "the %s of \"%s\" is too long, the item is skipped [%s:%d]", m.idCut ? "objectId" : "itemURL", m.title, __FILENAME__, __LINE__);
+        log_e("%s", m_chbuf);
+        cbInfo(m_chbuf);
+        return;
+    }
+    char* p = strchr(m.duration, '.'); if(p) *p = '\0';  // 0:03:25.000 -> 0:03:25
+    if(!m.isItem && !m.title[0]) strcpy(m.title, "Unknown");
+    auto value = [&](const char* str) -> const char* {return str[0] ? str : "?";}; // lambda, inner function
 
-            if(dlna_browseResult) dlna_browseResult(m_srvContent.objectId[cNr],
-                                                    m_srvContent.parentId[cNr],
-                                                    m_srvContent.childCount[cNr],
-                                                    m_srvContent.title[cNr],
-                                                    m_srvContent.isAudio[cNr],
-                                                    m_srvContent.itemSize[cNr],
-                                                    m_srvContent.duration[cNr],
-                                                    m_srvContent.itemURL[cNr]);
-
-        }
-        /*------ I T E M -------*/
-        if(startsWith(content, "item id")) {item2 = true; memset(m_chbuf, 0, m_chbufSize);}
-        if(item2){
-            strcat(m_chbuf, content);
-        }
-        if(startsWith(content, "/item")) {
-            item2 = false;
-            uint16_t cNr = m_srvContent.size;
-            makeContentPushBack();
-
-            replacestr(m_chbuf, "&quot", "\"");
-            replacestr(m_chbuf, "&ampamp", "&");   // ampersand
-            replacestr(m_chbuf, "&ampapos", "'");  // apostrophe
-            replacestr(m_chbuf, "&ampquot", "\""); // quotation
-            replacestr(m_chbuf, "&lt", "<");
-            replacestr(m_chbuf, "&gt", ">");
-
-            a = indexOf(m_chbuf, "item id=", 0);
-            if(a >= 0) {
-                a += 9;
-                b = indexOf(m_chbuf, "\"", a);
-                if(m_srvContent.objectId[cNr]) { free(m_srvContent.objectId[cNr]); m_srvContent.objectId[cNr] = NULL;}
-                m_srvContent.objectId[cNr] = x_ps_strndup(m_chbuf + a, b - a);
-            }
+    addItem(value(m.objectId), value(m.parentId), atoi(m.childCount), value(m.title), m.isItem && strstr(m.upnpClass, "object.item.audioItem") != NULL,
+            atol(m.itemSize), value(m.duration), value(m.itemURL));
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::addItem(const char* objectId, const char* parentId, uint16_t childCount, const char* title, bool isAudio, uint32_t itemSize,
+                          const char* duration, const char* itemURL){
 
-            a = indexOf(m_chbuf, "parentID=", 0);
-            if(a >= 0){
-                a += 10;
-                b = indexOf(m_chbuf, "\"", a);
-                if(m_srvContent.parentId[cNr]) { free(m_srvContent.parentId[cNr]); m_srvContent.parentId[cNr] = NULL;}
-                m_srvContent.parentId[cNr] = x_ps_strndup(m_chbuf + a, b - a);
-            }
+    if(m_crawlRun) {crawlItem(objectId, parentId, title, isAudio, itemSize, duration, itemURL); return;} // not for the application
 
-            a = indexOf(m_chbuf, "object.item.audioItem", 0);
-            if(a < 0) {m_srvContent.isAudio[cNr] = 0;}
-            else      {m_srvContent.isAudio[cNr] = 1;}
-
-            a = indexOf(m_chbuf, "dc:title", 0);
-            if(a >= 0){
-                a += 9;
-                b = indexOf(m_chbuf, "/dc:title", a);
-                b -= 1;
-                if(m_srvContent.title[cNr]) { free(m_srvContent.title[cNr]); m_srvContent.title[cNr] = NULL;}
-                m_srvContent.title[cNr] = x_ps_strndup(m_chbuf + a, b - a);
+    if(m_captureOn){ // record for the browse cache: 5 strings, childCount, isAudio, itemSize
+        const char* str[5] = {objectId, parentId, title, duration, itemURL};
+        uint32_t need = 7;
+        for(uint8_t i = 0; i < 5; i++) need += strlen(str[i]) + 1;
+        if(m_captureLen + need > m_cacheBudget) m_captureOn = false; // too big for the cache
+        else{
+            if(m_captureLen + need > m_captureSize){
+                uint32_t size = (m_captureLen + need) * 2;
+                if(size > m_cacheBudget) size = m_cacheBudget;
+                if(!mem_grow(m_captureSize, size)) m_captureOn = false; // memory limit
+                else{
+                    char* p = x_ps_realloc(m_capture, size);
+                    if(p) {m_capture = p; m_captureSize = size;}
+                    else  {m_capture = NULL; m_captureSize = 0; m_captureOn = false;} // x_ps_realloc() has freed it
+                }
             }
+            if(m_captureOn){
+                char* p = m_capture + m_captureLen;
+                for(uint8_t i = 0; i < 5; i++) {uint16_t l = strlen(str[i]) + 1; memcpy(p, str[i], l); p += l;}
+                memcpy(p, &childCount, 2); p[2] = isAudio; memcpy(p + 3, &itemSize, 4);
+                m_captureLen += need;
+            }
+        }
+    }
 
-            a = indexOf(m_chbuf, "<res", 0);
-            b = indexOf(m_chbuf, "/res>", a);
-            if(a > 0){
-                if(b > a) m_chbuf[b] = '\0';
-
-                c = indexOf(m_chbuf, ">http", a);
-                if(c >= 0){
-                    c += 1;
-                    d = indexOf(m_chbuf, "<", c);
-                    if(m_srvContent.itemURL[cNr]) { free(m_srvContent.itemURL[cNr]); m_srvContent.itemURL[cNr] = NULL;}
-                    m_srvContent.itemURL[cNr] = x_ps_strndup(m_chbuf + c, d - c);
-                }
+    if(!m_storeFull){
+        if(m_recordCount == m_recordSize) srvContent_reserve(m_recordSize ? m_recordSize * 2 : 16);
+        if(m_recordCount == m_recordSize) srvContent_reserve(m_recordSize + m_recordSize / 8 + 1); // memory limit, smaller steps
+        if(m_recordCount == m_recordSize) srvContent_reserve(m_recordSize + 1);
+        uint32_t poolLen = m_poolLen;
+        itemRecord_t r;
+        r.objectId = pool_strdup(objectId);
+        r.parentId = pool_strdup(parentId);
+        r.title    = pool_strdup(title);
+        r.duration = pool_strdup(duration);
+        r.itemURL  = pool_strdup(itemURL);
+        if(m_recordCount == m_recordSize || m_recordCount == 0xFFFF ||
+           r.objectId == UINT32_MAX || r.parentId == UINT32_MAX || r.title == UINT32_MAX || r.duration == UINT32_MAX || r.itemURL == UINT32_MAX){
+            if(m_pool) m_poolLen = poolLen; // memory limit or oom, the following items are reported only
+            m_storeFull = true;
+        }
+        else{
+            r.itemSize = itemSize;
+            r.childCount = childCount;
+            r.isAudio = isAudio;
+            m_records[m_recordCount++] = r;
+            if(m_listener) {if(m_batchSize && m_recordCount - m_batchFirst >= m_batchSize) cbItems(); return;}
+            contentItem_t c = getItem(m_recordCount - 1);
+            if(dlna_browseResult) dlna_browseResult(c.objectId, c.parentId, c.childCount, c.title, c.isAudio, c.itemSize, c.duration, c.itemURL);
+            return;
+        }
+    }
+    m_storeSkipped++;
+    if(m_listener){
+        cbItems(); // the stored ones first, keeps the order
+        contentItem_t c = {objectId, parentId, title, duration, itemURL, itemSize, childCount, isAudio};
+        m_listener->onBrowseItem(c);
+        return;
+    }
+    if(dlna_browseResult) dlna_browseResult(objectId, parentId, childCount, title, isAudio, itemSize, duration, itemURL);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::searchServer(uint8_t srvNr, const char* containerId, const char* searchCriteria, const uint16_t startingIndex, const uint16_t maxCount){
+    if(!containerId || !searchCriteria) {log_e("containerId or searchCriteria is NULL"); return -1;}
+    if(srvNr >= m_dlnaServer.size) {log_e("server index too high"); return -2;}
+    if(strcmp(m_dlnaServer.controlURL[srvNr], "?") == 0) {log_e("server description not read yet"); return -2;}
+    if(m_state != IDLE) {log_e("state is not idle"); return -3;}
+    const char* caps = getSearchCapabilities(srvNr);
+    if(caps && !searchSupported(caps, searchCriteria)) {log_e("the server can't search for this"); return -4;} // fall back to browseServer()
 
-                c = indexOf(m_chbuf, "duration=", a);
-                if(c >= 0){
-                    c += 10;
-                    d = indexOf(m_chbuf, "\"", c) - 4;
-                    if(d > c){
-                        if(m_srvContent.duration[cNr]) { free(m_srvContent.duration[cNr]); m_srvContent.duration[cNr] = NULL;}
-                        m_srvContent.duration[cNr] = x_ps_strndup(m_chbuf + c, d - c);
-                    }
-                }
+    m_srvNr = srvNr;
+    if(m_objectId) free(m_objectId);
+    m_objectId = x_ps_strdup(containerId);
+    if(m_searchCriteria) free(m_searchCriteria);
+    m_searchCriteria = x_ps_strdup(searchCriteria);
+    m_startingIndex = startingIndex;
+    m_maxCount = maxCount;
+    m_paged = false;
+    m_metadata = false;
+    m_state = SEARCH_SERVER;
+    return 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char* DLNA_Client::getSearchCapabilities(uint8_t srvNr){ // NULL: not asked yet, "": no search
+    if(srvNr >= m_dlnaServer.size) return NULL;
+    uint32_t srvKey = fnv1a(m_dlnaServer.udn[srvNr]);
+    for(uint16_t i = 0; i < m_searchCaps.size(); i++){
+        if(m_searchCaps[i].srvKey == srvKey) return m_searchCaps[i].caps;
+    }
+    return NULL;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char* DLNA_Client::searchCaps(uint8_t srvNr){ // ask the server once
+    const char* caps = getSearchCapabilities(srvNr);
+    if(caps) return caps;
+    m_searchCapsBuf[0] = '\0';
+    bool res = srvCall(srvNr, "GetSearchCapabilities");
+    if(res) res = readHttpHeader();
+    if(res) res = readBody();
+    connRelease(res, srvNr);
+    return searchCapsStore(srvNr, res);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char* DLNA_Client::searchCapsStore(uint8_t srvNr, bool ok){ // the response of GetSearchCapabilities has been read, ok: without error
+    if(!ok || (m_httpStatus != 200 && m_httpStatus != 500)) return NULL; // try again next time, 500: SOAP fault, no search
+    m_searchCaps.push_back({fnv1a(m_dlnaServer.udn[srvNr]), x_ps_strdup(m_searchCapsBuf)}); // an error response leaves it empty
+    return m_searchCaps.back().caps;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::searchSupported(const char* caps, const char* criteria){ // all properties of the criteria are searchable
+    if(!caps[0]) return false;
+    if(strcmp(caps, "*") == 0) return true;
+    const char* p = criteria;
+    bool quoted = false;
+    while(*p){
+        if(*p == '"') {quoted = !quoted; p++; continue;}
+        if(quoted || *p == ' ' || *p == '(' || *p == ')') {if(quoted && *p == '\\' && p[1]) p++; p++; continue;}
+        const char* w = p; // a word: property, operator or value
+        while(*p && *p != ' ' && *p != '(' && *p != ')' && *p != '"') p++;
+        uint16_t len = p - w;
+        if(!memchr(w, ':', len) && !memchr(w, '@', len)) continue; // not a property
+        bool found = false;
+        const char* c = caps;
+        while(*c && !found){
+            const char* e = strchr(c, ',');
+            if(!e) e = c + strlen(c);
+            while(*c == ' ') c++;
+            found = (uint16_t)(e - c) == len && strncmp(c, w, len) == 0;
+            c = *e ? e + 1 : e;
+        }
+        if(!found) return false;
+    }
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::search(){ // Search, the result goes through the same DIDL-Lite path as Browse
+    if(!searchCheck(searchCaps(m_srvNr))) return false;
+    bool res = searchSend(true);
+    if(res) res = readHttpHeader();
+    if(res) res = readContent();
+    connRelease(res, m_srvNr);
+    return res;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::searchCheck(const char* caps){ // false: the server can't do this search, the application is told
+    if(caps && searchSupported(caps, m_searchCriteria)) return true;
+    sprintf(m_chbuf, "The server %s:%d does not support this search, use browseServer() [%s:%d]", m_dlnaServer.ip[m_srvNr], m_dlnaServer.port[m_srvNr], __FILENAME__, __LINE__);
+    cbInfo(m_chbuf);
+    return false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::searchSend(bool wait){ // wait: until the response arrives, else callStep() waits
 
-                a = indexOf(m_chbuf, "size=", a);
-                if(a > 0){
-                    a += 6;
-                    b = indexOf(m_chbuf, "\"", a);
-                    char tmp[60] = {0}; memcpy(tmp, m_chbuf + a, b - a);
-                    m_srvContent.itemSize[cNr] = atol(tmp);
-                }
-            }
+    char* id = xmlEscape(m_objectId); // the criteria contain quotes and may contain & or <
+    char* criteria = xmlEscape(m_searchCriteria);
+    char range[128];
+    snprintf(range, sizeof(range), "</Filter>\r\n"
+                                   "<StartingIndex>%u</StartingIndex>\r\n"
+                                   "<RequestedCount>%u</RequestedCount>\r\n"
+                                   "<SortCriteria></SortCriteria>\r\n", m_startingIndex, m_maxCount);
+    const char* args[] = {"<ContainerID>", id ? id : m_objectId, "</ContainerID>\r\n<SearchCriteria>", criteria ? criteria : m_searchCriteria,
+                          "</SearchCriteria>\r\n<Filter>", filterString(m_filter), range};
+    bool res = wait ? srvCall(m_srvNr, "Search", args, sizeof(args) / sizeof(args[0]))
+                    : srvSoap(m_client, m_stepReused, m_srvNr, "Search", args, sizeof(args) / sizeof(args[0]), false);
+    if(id) free(id);
+    if(criteria) free(criteria);
+    return res;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+static int indexCompare(const void* a, const void* b){ // qsort, the key is the first member of indexEntry_t
+    return memcmp(a, b, INDEX_KEY_LEN);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::startCrawl(uint8_t srvNr, fs::FS& fs, const char* dir){ // walk the whole tree of the server in the background, an interrupted crawl is resumed
+    if(srvNr >= m_dlnaServer.size) {log_e("server index too high"); return false;}
+    if(strlen(dir) >= sizeof(m_crawlDir)) {log_e("dir is too long"); return false;}
+    crawlAbort();
+    indexAbort();
+    chbuf_alloc();
+    m_crawlFS = &fs;
+    strcpy(m_crawlDir, dir);
+    fs.mkdir(dir);
 
-            if(dlna_browseResult) dlna_browseResult(m_srvContent.objectId[cNr],
-                                                    m_srvContent.parentId[cNr],
-                                                    m_srvContent.childCount[cNr],
-                                                    m_srvContent.title[cNr],
-                                                    m_srvContent.isAudio[cNr],
-                                                    m_srvContent.itemSize[cNr],
-                                                    m_srvContent.duration[cNr],
-                                                    m_srvContent.itemURL[cNr]);
+    bool resume = false;
+    File f = fs.open(crawlPath("crawl.dat"), FILE_READ);
+    if(f){
+        resume = f.read((uint8_t*)&m_crawl, sizeof(m_crawl)) == sizeof(m_crawl) && m_crawl.magic == CRAWL_MAGIC && !m_crawl.done &&
+                 strcmp(m_crawl.udn, m_dlnaServer.udn[srvNr]) == 0;
+        f.close();
+    }
+    if(resume){ // drop what the page that was running at the reset has written
+        crawlTruncate("queue.dat", m_crawl.queueLen);
+        crawlTruncate("items.dat", m_crawl.itemsLen);
+    }
+    else{
+        memset(&m_crawl, 0, sizeof(m_crawl));
+        m_crawl.magic = CRAWL_MAGIC;
+        strncpy(m_crawl.udn, m_dlnaServer.udn[srvNr], sizeof(m_crawl.udn) - 1);
+        fs.remove(crawlPath("title.idx"));
+        File q = fs.open(crawlPath("queue.dat"), FILE_WRITE);
+        File i = fs.open(crawlPath("items.dat"), FILE_WRITE);
+        bool ok = q && i && q.write((const uint8_t*)"0", 2) == 2; // root container
+        if(q) q.close();
+        if(i) i.close();
+        if(!ok) {log_e("can't write to %s", dir); return false;}
+        m_crawl.queueLen = 2;
+        if(!crawlSave()) return false;
+    }
+    m_crawlFails = 0;
+    m_crawlActive = true;
+    m_crawlLast = millis();
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::stopCrawl(){ // the state is saved after each page, startCrawl() continues from there
+    crawlAbort();
+    indexAbort();
+    m_crawlActive = false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char* DLNA_Client::crawlPath(const char* name){
+    snprintf(m_crawlPath, sizeof(m_crawlPath), "%s/%s", m_crawlDir, name);
+    return m_crawlPath;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::crawlSave(){ // LittleFS replaces the file content on close as a whole, a reset leaves the old state
+    File f = m_crawlFS->open(crawlPath("crawl.dat"), FILE_WRITE);
+    if(!f) {log_e("can't write %s", m_crawlPath); return false;}
+    bool ok = f.write((const uint8_t*)&m_crawl, sizeof(m_crawl)) == sizeof(m_crawl);
+    f.close();
+    return ok;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::crawlTruncate(const char* name, uint32_t len){ // FS has no truncate(), copy the valid part
+    char path[48];
+    strcpy(path, crawlPath(name));
+    File f = m_crawlFS->open(path, FILE_READ);
+    if(!f) return;
+    if(f.size() <= len) {f.close(); return;}
+    File t = m_crawlFS->open(crawlPath("tmp.dat"), FILE_WRITE);
+    char* buf = x_ps_malloc(512);
+    if(t && buf){
+        uint32_t done = 0;
+        while(done < len){
+            uint16_t n = (len - done > 512) ? 512 : len - done;
+            if(f.read((uint8_t*)buf, n) != n) break;
+            t.write((const uint8_t*)buf, n);
+            done += n;
         }
+    }
+    if(buf) free(buf);
+    f.close();
+    if(!t) return;
+    t.close();
+    m_crawlFS->remove(path);
+    m_crawlFS->rename(crawlPath("tmp.dat"), path);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::crawlStep(){ // one page of the current container in steps that don't wait, called from loop() while IDLE
 
-        if(startsWith(content, "<NumberReturned>")){;
-            b= indexOf(content, "</NumberReturned>", 16);
-            char tmp[10] = {0}; memcpy(tmp, content + 16, b - 16);
-            m_numberReturned = atoi(tmp);
+    if(m_idx.phase != IDX_OFF) {indexStep(); return;}
+    if(!m_crawlPage){
+        m_crawlLast = millis();
+        if(m_crawl.queuePos >= m_crawl.queueLen) {indexStart(); return;} // all containers are read
+        int16_t srvNr = findServer(m_crawl.udn);
+        if(srvNr < 0 || strcmp(m_dlnaServer.controlURL[srvNr], "?") == 0) return; // the server is not there (yet)
+
+        uint16_t n = 0;
+        m_crawlIdLen = 0; // bytes in queue.dat, with the terminating 0
+        File q = m_crawlFS->open(crawlPath("queue.dat"), FILE_READ);
+        if(!q) {log_e("can't read %s", m_crawlPath); stopCrawl(); return;}
+        q.seek(m_crawl.queuePos);
+        while(m_crawl.queuePos + m_crawlIdLen < m_crawl.queueLen){
+            int c = q.read();
+            if(c < 0) break;
+            m_crawlIdLen++;
+            if(c == 0) break;
+            if(n < sizeof(m_crawlId) - 1) m_crawlId[n++] = c;
         }
+        m_crawlId[n] = '\0';
+        q.close();
+
+        m_crawlQueue = m_crawlFS->open(crawlPath("queue.dat"), FILE_APPEND);
+        m_crawlItems = m_crawlFS->open(crawlPath("items.dat"), FILE_APPEND);
+        m_crawlSaved = m_crawl;
+        m_crawlReturned = 0;
+        m_crawlTotal = 0;
+        m_crawlPage = true;
+        m_crawlRun = true;
+        if(!m_crawlQueue || !m_crawlItems) {crawlPageDone(false); return;}
+        m_call = CALL_CRAWL;
+        m_callSrv = srvNr;
+        m_stepAttempt = 0;
+        m_timeStamp = millis();
+        m_step = STEP_CONNECT;
+    }
+    int8_t r = callStep();
+    if(r == 0) return; // next loop()
+    crawlPageDone(r > 0);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::crawlPageDone(bool res){
+
+    connRelease(res, m_callSrv);
+    m_crawlRun = false;
+    m_crawlPage = false;
+    if(m_crawlQueue) m_crawlQueue.close();
+    if(m_crawlItems) m_crawlItems.close();
+    uint16_t returned = m_crawlReturned;
+
+    if(!res){
+        m_crawl = m_crawlSaved;
+        crawlTruncate("queue.dat", m_crawl.queueLen);
+        crawlTruncate("items.dat", m_crawl.itemsLen);
+        if(++m_crawlFails < CRAWL_ATTEMPTS) return; // try again after CRAWL_INTERVAL
+        log_e("container %s skipped", m_crawlId);
+        returned = 0;
+    }
+    m_crawlFails = 0;
+    uint32_t next = m_crawl.startingIndex + returned;
+    if(returned && next < m_crawlTotal && next <= 0xFFFF){
+        m_crawl.startingIndex = next;
+    }
+    else{ // container done
+        m_crawl.queuePos += m_crawlIdLen;
+        m_crawl.startingIndex = 0;
+    }
+    crawlSave(); // all containers done: crawlStep() builds the index
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::crawlAbort(){ // a request goes first, the page is read again later
+    if(!m_crawlPage) return;
+    if(m_stepFd >= 0) {close(m_stepFd); m_stepFd = -1;}
+    m_client.stop();
+    m_step = STEP_START;
+    m_crawlRun = false;
+    m_crawlPage = false;
+    if(m_crawlQueue) m_crawlQueue.close();
+    if(m_crawlItems) m_crawlItems.close();
+    m_crawl = m_crawlSaved;
+    crawlTruncate("queue.dat", m_crawl.queueLen);
+    crawlTruncate("items.dat", m_crawl.itemsLen);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::crawlItem(const char* objectId, const char* parentId, const char* title, bool isAudio, uint32_t itemSize, const char* duration, const char* itemURL){
+
+    if(!m_item.isItem){ // container, its children are read later
+        if(strcmp(objectId, "?") == 0) return;
+        uint16_t l = strlen(objectId) + 1;
+        if(m_crawlQueue.write((const uint8_t*)objectId, l) == l) m_crawl.queueLen += l;
+        return;
+    }
+    if(!isAudio) return;
+    const char* str[5] = {objectId, parentId, title, duration, itemURL}; // record: len, itemSize, 5 strings
+    uint8_t hdr[6];
+    uint16_t len = sizeof(hdr);
+    for(uint8_t i = 0; i < 5; i++) len += strlen(str[i]) + 1;
+    memcpy(hdr, &len, 2);
+    memcpy(hdr + 2, &itemSize, 4);
+    uint16_t n = m_crawlItems.write(hdr, sizeof(hdr));
+    for(uint8_t i = 0; i < 5; i++) n += m_crawlItems.write((const uint8_t*)str[i], strlen(str[i]) + 1);
+    m_crawl.itemsLen += n;
+    if(n == len) m_crawl.tracks++;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexKey(char* key, const char* title){ // lowercase, zero padded, leading blanks removed
+    memset(key, 0, INDEX_KEY_LEN);
+    while(*title == ' ') title++;
+    for(uint8_t i = 0; i < INDEX_KEY_LEN && title[i]; i++) key[i] = tolower((uint8_t)title[i]);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexStart(){ // all containers are read, title.idx is built by indexStep(): sorted runs, then merged on flash
+
+    indexBuild_t& b = m_idx;
+    b.items = m_crawlFS->open(crawlPath("items.dat"), FILE_READ);
+    b.run = m_crawlFS->open(crawlPath("idx0.tmp"), FILE_WRITE);
+    b.buf = (indexEntry_t*)x_ps_malloc(INDEX_SORT_RUN * sizeof(indexEntry_t));
+    b.rec = x_ps_malloc(1024);
+    b.fill = 0;
+    b.offset = 0;
+    b.n = 0;
+    b.phase = IDX_RUNS;
+    if(!b.items || !b.run || !b.buf || !b.rec) indexDone(false);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexStep(){ // INDEX_STEP records or entries per loop() call, less if the budget of setLoopBudget() is used up
+    for(uint16_t k = 0; k < INDEX_STEP && m_idx.phase != IDX_OFF; k++){
+        if(k && budgetUsed(0)) return;
+        if(m_idx.phase == IDX_RUNS) indexRunStep();
+        else indexMergeStep();
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexRunStep(){ // one record of items.dat, a full buffer is sorted and written as a run
+
+    indexBuild_t& b = m_idx;
+    uint8_t hdr[6];
+    uint16_t len = 0;
+    bool more = b.offset < m_crawl.itemsLen && b.items.read(hdr, sizeof(hdr)) == sizeof(hdr);
+    if(more) {memcpy(&len, hdr, 2); more = len > sizeof(hdr) && len <= 1024 + sizeof(hdr);}
+    if(more) more = b.items.read((uint8_t*)b.rec, len - sizeof(hdr)) == (size_t)(len - sizeof(hdr));
+    if(more){
+        b.rec[len - sizeof(hdr) - 1] = '\0';
+        const char* title = b.rec + strlen(b.rec) + 1;  // objectId, parentId, title
+        title += strlen(title) + 1;
+        indexKey(b.buf[b.fill].key, title);
+        b.buf[b.fill].offset = b.offset;
+        b.fill++; b.n++;
+        b.offset += len;
+    }
+    if(b.fill && (b.fill == INDEX_SORT_RUN || !more)){
+        qsort(b.buf, b.fill, sizeof(indexEntry_t), indexCompare);
+        b.run.write((const uint8_t*)b.buf, b.fill * sizeof(indexEntry_t));
+        b.fill = 0;
+    }
+    if(more) return;
+    b.items.close();
+    b.run.close();
+    free(b.buf); b.buf = NULL;
+    free(b.rec); b.rec = NULL;
+    b.src = "idx0.tmp";
+    b.dst = "idx1.tmp";
+    b.runLen = INDEX_SORT_RUN;
+    indexPass();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexPass(){ // bottom-up merge sort, the run length doubles with each pass, one run left: title.idx
+
+    indexBuild_t& b = m_idx;
+    if(b.runLen >= b.n){
+        char path[48];
+        strcpy(path, crawlPath(b.src));
+        m_crawlFS->remove(crawlPath(b.dst));
+        m_crawlFS->remove(crawlPath("title.idx"));
+        indexDone(m_crawlFS->rename(path, crawlPath("title.idx")));
+        return;
+    }
+    b.a = m_crawlFS->open(crawlPath(b.src), FILE_READ);
+    b.b = m_crawlFS->open(crawlPath(b.src), FILE_READ);
+    b.out = m_crawlFS->open(crawlPath(b.dst), FILE_WRITE);
+    if(!b.a || !b.b || !b.out) {indexDone(false); return;}
+    b.phase = IDX_MERGE;
+    b.lo = 0;
+    indexPair();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexPair(){ // the runs [lo, mid) and [mid, hi) are merged next
+    const uint8_t E = sizeof(indexEntry_t);
+    indexBuild_t& b = m_idx;
+    b.mid = (b.lo + b.runLen < b.n) ? b.lo + b.runLen : b.n;
+    b.hi = (b.lo + 2 * b.runLen < b.n) ? b.lo + 2 * b.runLen : b.n;
+    b.i = b.lo;
+    b.j = b.mid;
+    b.a.seek(b.lo * E);
+    b.b.seek(b.mid * E);
+    if(b.i < b.mid) b.a.read((uint8_t*)&b.x, E);
+    if(b.j < b.hi)  b.b.read((uint8_t*)&b.y, E);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexMergeStep(){ // one entry of the current pair of runs
 
-        if(startsWith(content, "<TotalMatches>")){
-            b= indexOf(content, "</TotalMatches>", 14);
-            char tmp[10] = {0}; memcpy(tmp, content + 14, b - 14);
-            m_totalMatches = atoi(tmp);
+    const uint8_t E = sizeof(indexEntry_t);
+    indexBuild_t& b = m_idx;
+    if(b.i < b.mid || b.j < b.hi){
+        if(b.j >= b.hi || (b.i < b.mid && memcmp(b.x.key, b.y.key, INDEX_KEY_LEN) <= 0)){
+            b.out.write((const uint8_t*)&b.x, E);
+            if(++b.i < b.mid) b.a.read((uint8_t*)&b.x, E);
         }
+        else{
+            b.out.write((const uint8_t*)&b.y, E);
+            if(++b.j < b.hi) b.b.read((uint8_t*)&b.y, E);
+        }
+        return;
+    }
+    b.lo += 2 * b.runLen;
+    if(b.lo < b.n) {indexPair(); return;}
+    b.a.close(); // the pass is done
+    b.b.close();
+    b.out.close();
+    const char* t = b.src; b.src = b.dst; b.dst = t;
+    b.runLen *= 2;
+    indexPass();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexDone(bool ok){ // the crawl is complete
+    indexAbort();
+    m_crawlActive = false;
+    m_crawl.done = ok;
+    crawlSave();
+    cbCrawlReady();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::indexAbort(){ // stopCrawl(), the index is built again when the crawl goes on
+    indexBuild_t& b = m_idx;
+    if(b.items) b.items.close();
+    if(b.run) b.run.close();
+    if(b.a) b.a.close();
+    if(b.b) b.b.close();
+    if(b.out) b.out.close();
+    if(b.buf) {free(b.buf); b.buf = NULL;}
+    if(b.rec) {free(b.rec); b.rec = NULL;}
+    b.phase = IDX_OFF;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::openIndex(fs::FS& fs, const char* dir){ // the index of an earlier crawl
+    if(strlen(dir) >= sizeof(m_crawlDir)) return false;
+    m_crawlFS = &fs;
+    strcpy(m_crawlDir, dir);
+    return fs.exists(crawlPath("title.idx"));
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::getIndexSize(){ // number of tracks
+    if(!m_crawlFS) return 0;
+    File idx = m_crawlFS->open(crawlPath("title.idx"), FILE_READ);
+    if(!idx) return 0;
+    uint32_t n = idx.size() / sizeof(indexEntry_t);
+    idx.close();
+    return n;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::indexRecord(File& items, uint32_t offset, const char* prefix){ // read a track from items.dat and report it like a Browse result
+    uint8_t hdr[6];
+    uint16_t len;
+    uint32_t itemSize;
+    if(!items.seek(offset) || items.read(hdr, sizeof(hdr)) != sizeof(hdr)) return false;
+    memcpy(&len, hdr, 2);
+    memcpy(&itemSize, hdr + 2, 4);
+    if(len <= sizeof(hdr) || len > 1024 + sizeof(hdr)) return false;
+    char* rec = x_ps_malloc(len);
+    if(!rec) return false;
+    bool ok = items.read((uint8_t*)rec, len - sizeof(hdr)) == (size_t)(len - sizeof(hdr));
+    rec[len - sizeof(hdr) - 1] = '\0';
+    const char* str[5];
+    const char* p = rec;
+    const char* end = rec + len - sizeof(hdr); // the strings follow the fixed fields
+    for(uint8_t i = 0; i < 5 && ok; i++) {str[i] = p; if(p >= end) ok = false; else p += strlen(p) + 1;}
+    if(ok && prefix){ // the key has only INDEX_KEY_LEN bytes
+        const char* t = str[2];
+        while(*t == ' ') t++;
+        while(*prefix == ' ') prefix++;
+        ok = strncasecmp(t, prefix, strlen(prefix)) == 0;
+    }
+    if(ok) addItem(str[0], str[1], 0, str[2], true, itemSize, str[3], str[4]);
+    free(rec);
+    return ok;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int32_t DLNA_Client::indexSearch(const char* titlePrefix, uint16_t maxCount){ // tracks whose title starts with titlePrefix, no network traffic
+    if(!titlePrefix || !m_crawlFS) return -1;
+    if(m_state != IDLE) {log_e("state is not idle"); return -3;}
+    File idx = m_crawlFS->open(crawlPath("title.idx"), FILE_READ);
+    File items = m_crawlFS->open(crawlPath("items.dat"), FILE_READ);
+    if(!idx || !items) {if(idx) idx.close(); if(items) items.close(); return -1;}
+
+    const uint8_t E = sizeof(indexEntry_t);
+    char key[INDEX_KEY_LEN];
+    indexKey(key, titlePrefix);
+    uint8_t kl = 0;
+    while(kl < INDEX_KEY_LEN && key[kl]) kl++;
+    uint32_t lo = 0, hi = idx.size() / E, n = hi;
+    indexEntry_t e;
+    while(lo < hi){ // binary search, first entry >= key
+        uint32_t mid = (lo + hi) / 2;
+        idx.seek(mid * E);
+        idx.read((uint8_t*)&e, E);
+        if(memcmp(e.key, key, kl) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    srvContent_clear();
+    srvContent_reserve(maxCount);
+    int32_t cnt = 0;
+    for(uint32_t i = lo; i < n && cnt < maxCount; i++){
+        idx.seek(i * E);
+        if(idx.read((uint8_t*)&e, E) != E || memcmp(e.key, key, kl) != 0) break;
+        if(indexRecord(items, e.offset, kl == INDEX_KEY_LEN ? titlePrefix : NULL)) cnt++;
+    }
+    idx.close();
+    items.close();
+    cbItems();
+    return cnt;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int32_t DLNA_Client::indexList(uint32_t startIndex, uint16_t maxCount){ // all tracks sorted by title, e.g. "play all"
+    if(!m_crawlFS) return -1;
+    if(m_state != IDLE) {log_e("state is not idle"); return -3;}
+    File idx = m_crawlFS->open(crawlPath("title.idx"), FILE_READ);
+    File items = m_crawlFS->open(crawlPath("items.dat"), FILE_READ);
+    if(!idx || !items) {if(idx) idx.close(); if(items) items.close(); return -1;}
+    srvContent_clear();
+    srvContent_reserve(maxCount);
+    int32_t cnt = 0;
+    indexEntry_t e;
+    idx.seek(startIndex * sizeof(indexEntry_t));
+    while(cnt < maxCount && idx.read((uint8_t*)&e, sizeof(e)) == sizeof(e)){
+        if(indexRecord(items, e.offset)) cnt++;
+    }
+    idx.close();
+    items.close();
+    cbItems();
+    return cnt;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::setBrowseFilter(uint16_t filter){ // properties the server returns, e.g. FILTER_TITLE | FILTER_RES
+    m_filter = filter & FILTER_MINIMAL;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::setMemoryLimit(uint32_t bytes){ // e.g. 32768 without PSRAM: receive buffer, browse result and cache stay below it, 0: no limit
+    m_memLimit = bytes;
+    if(!bytes) return;
+    while(m_browseCache.size() && mem_used() > m_memLimit) cacheDrop(0);
+    if(mem_used() > m_memLimit){ // give back what the last browse has reserved
+        srvContent_clear_and_shrink();
+        if(m_capture) {free(m_capture); m_capture = NULL; m_captureSize = 0;}
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::getMemoryPeak(bool reset){ // highest value of the tracked heap since the last reset
+    uint32_t peak = m_memPeak;
+    if(reset) m_memPeak = mem_used();
+    return peak;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::enableBrowseCache(uint32_t budget){ // 0 disables the cache
+    m_cacheBudget = budget;
+    while(m_browseCache.size() && m_cacheBytes > m_cacheBudget) cacheDrop(0);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::clearBrowseCache(){
+    while(m_browseCache.size()) cacheDrop(0);
+    m_sysUpdate.clear();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::browseCached(){ // true if the Browse was answered from the cache
+
+    m_captureOn = false;
+    uint32_t sysId = 0;
+    if(!systemUpdateId(m_srvNr, sysId)) return false; // no validation possible, don't cache
+    return cacheLookup(sysId);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::cacheLookup(uint32_t sysId){ // true: replayed, else the response of the Browse is captured for the cache
+    int16_t idx = cacheFind(fnv1a(m_dlnaServer.udn[m_srvNr]), m_objectId, m_startingIndex, m_maxCount);
+    if(idx >= 0){
+        if(m_browseCache[idx].systemUpdateId == sysId) {cacheReplay(idx); return true;}
+        cacheDrop(idx); // outdated
     }
-    if(dlna_browseReady) dlna_browseReady(m_numberReturned, m_totalMatches);
+    m_captureSysId = sysId;
+    m_captureLen = 0;
+    m_captureOn = true;
+    return false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::systemUpdateId(uint8_t srvNr, uint32_t& id){ // SystemUpdateID of the server, asked at most every BROWSE_CACHE_TRUST ms
+
+    int8_t known = systemUpdateIdKnown(srvNr, id);
+    if(known >= 0) return known > 0;
+    bool res = srvCall(srvNr, "GetSystemUpdateID");
+    if(res) res = readHttpHeader();
+    if(res) res = readBody();
+    connRelease(res, srvNr);
+    return systemUpdateIdStore(srvNr, res, id);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::systemUpdateIdKnown(uint8_t srvNr, uint32_t& id){ // 1: id is recent enough, 0: not supported by the server, -1: ask the server
+    uint32_t srvKey = fnv1a(m_dlnaServer.udn[srvNr]);
+    int16_t i = m_sysUpdate.size() - 1;
+    while(i >= 0 && m_sysUpdate[i].srvKey != srvKey) i--;
+    if(i >= 0 && !m_sysUpdate[i].supported) return 0;
+    if(i >= 0 && millis() - m_sysUpdate[i].checked < BROWSE_CACHE_TRUST) {id = m_sysUpdate[i].id; return 1;}
+    return -1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::systemUpdateIdStore(uint8_t srvNr, bool ok, uint32_t& id){ // the response of GetSystemUpdateID has been read, ok: without error
+    uint32_t srvKey = fnv1a(m_dlnaServer.udn[srvNr]);
+    int16_t i = m_sysUpdate.size() - 1;
+    while(i >= 0 && m_sysUpdate[i].srvKey != srvKey) i--;
+    if(!ok || (m_httpStatus != 200 && m_httpStatus != 500)) return false; // network error or busy server, asked again next time
+    if(i < 0) {m_sysUpdate.push_back({srvKey, 0, 0, true}); i = m_sysUpdate.size() - 1;}
+    if(!m_updateIdSeen) {m_sysUpdate[i].supported = false; return false;} // complete response without <Id>
+    id = m_updateId;
+    if(m_sysUpdate[i].id != id) cacheDropServer(srvKey); // something has changed on the server
+    m_sysUpdate[i].id = id;
+    m_sysUpdate[i].checked = millis();
     return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-bool DLNA_Client::srvPost(uint8_t srvNr, const char* objectId, const uint16_t startingIndex, const uint16_t maxCount){
+int16_t DLNA_Client::cacheFind(uint32_t srvKey, const char* objectId, uint16_t startingIndex, uint16_t maxCount){
+    for(int16_t i = m_browseCache.size() - 1; i >= 0; i--){
+        cacheEntry_t& e = m_browseCache[i];
+        if(e.srvKey == srvKey && e.startingIndex == startingIndex && e.maxCount == maxCount && e.filter == m_filter && strcmp(e.objectId, objectId) == 0) return i;
+    }
+    return -1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cacheReplay(uint16_t idx){ // deliver the stored items as if they came from the server
 
-    bool ret;
-    uint8_t cnt = 0;
+    cacheEntry_t e = m_browseCache[idx];
+    m_browseCache.erase(m_browseCache.begin() + idx); // most recently used to the end
+    m_browseCache.push_back(e);
 
-    m_client.stop();
-    uint32_t t = millis();
-    m_client.setTimeout(CONNECT_TIMEOUT);
-    ret = m_client.connect(m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr]);
+    srvContent_clear();
+    srvContent_reserve(e.numberReturned);
+    const char* p = e.data;
+    while(p < e.data + e.len){
+        const char* str[5];
+        for(uint8_t i = 0; i < 5; i++) {str[i] = p; p += strlen(p) + 1;}
+        uint16_t childCount; uint32_t itemSize;
+        memcpy(&childCount, p, 2); bool isAudio = p[2]; memcpy(&itemSize, p + 3, 4);
+        p += 7;
+        addItem(str[0], str[1], childCount, str[2], isAudio, itemSize, str[3], str[4]);
+    }
+    m_numberReturned = e.numberReturned;
+    m_totalMatches = e.totalMatches;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cacheInsert(){ // the Browse response that was just read
 
-    if(!ret){
-        m_client.stop();
-        sprintf(m_chbuf, "The server %s:%d is not responding after %lums [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], millis() - t, __FILENAME__, __LINE__);
-        if(dlna_info) dlna_info(m_chbuf);
-        return false;
+    m_captureOn = false;
+    uint32_t srvKey = fnv1a(m_dlnaServer.udn[m_srvNr]);
+    for(int16_t i = m_browseCache.size() - 1; i >= 0; i--){ // other pages of this container are outdated if its UpdateID has changed
+        cacheEntry_t& e = m_browseCache[i];
+        if(e.srvKey == srvKey && strcmp(e.objectId, m_objectId) == 0 && (e.updateId != m_updateId || e.startingIndex == m_startingIndex)) cacheDrop(i);
     }
-    while(true){
-        if(m_client.connected()) break;
-        delay(100);
-        cnt++;
-        if(cnt == 10){
-            sprintf(m_chbuf, "The server %s:%d refuses the connection [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], __FILENAME__, __LINE__);
-            if(dlna_info) dlna_info(m_chbuf);
+    uint32_t bytes = m_captureLen + strlen(m_objectId) + 1 + sizeof(cacheEntry_t);
+    if(bytes > m_cacheBudget) return;
+    while(m_browseCache.size() && (m_cacheBytes + bytes > m_cacheBudget || !mem_grow(0, bytes))) cacheDrop(0); // least recently used
+    if(!mem_grow(0, bytes)) return;
+
+    cacheEntry_t e;
+    e.data = x_ps_malloc(m_captureLen + 1);
+    e.objectId = x_ps_strdup(m_objectId);
+    if(!e.data || !e.objectId) {if(e.data) free(e.data); if(e.objectId) free(e.objectId); return;}
+    memcpy(e.data, m_capture, m_captureLen);
+    e.len = m_captureLen;
+    e.srvKey = srvKey;
+    e.startingIndex = m_startingIndex;
+    e.maxCount = m_maxCount;
+    e.filter = m_filter;
+    e.numberReturned = m_numberReturned;
+    e.totalMatches = m_totalMatches;
+    e.systemUpdateId = m_captureSysId;
+    e.updateId = m_updateId;
+    m_browseCache.push_back(e);
+    m_cacheBytes += bytes;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cacheDrop(uint16_t idx){
+    cacheEntry_t& e = m_browseCache[idx];
+    m_cacheBytes -= e.len + strlen(e.objectId) + 1 + sizeof(cacheEntry_t);
+    free(e.data);
+    free(e.objectId);
+    m_browseCache.erase(m_browseCache.begin() + idx);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cacheDropServer(uint32_t srvKey){
+    for(int16_t i = m_browseCache.size() - 1; i >= 0; i--){
+        if(m_browseCache[i].srvKey == srvKey) cacheDrop(i);
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::connRelease(bool ok, uint8_t srvNr){ // park the connection of m_client if the response was read completely
+    if(ok && m_keepAlive && m_body.state == BODY_DONE && !m_body.surplus && !rx_used()) connPark(m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], m_client);
+    else m_client.stop();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::srvPost(uint8_t srvNr, const char* objectId, const uint16_t startingIndex, const uint16_t maxCount, bool metadata, uint16_t filter){
+
+    bool reused = false;
+
+    for(uint8_t attempt = 0; attempt < 2; attempt++){ // a reused connection may have been closed by the server meanwhile
+        if(!srvSend(m_client, reused, srvNr, objectId, startingIndex, maxCount, metadata, filter)) return false;
+        int8_t res = srvWait(srvNr, reused);
+        if(res >= 0) return res;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::srvCall(uint8_t srvNr, const char* action, const char** args, uint8_t argc){ // any ContentDirectory action, the response is read by readHttpHeader() and readBody()
+
+    bool reused = false;
+
+    for(uint8_t attempt = 0; attempt < 2; attempt++){
+        if(!srvSoap(m_client, reused, srvNr, action, args, argc)) return false;
+        int8_t res = srvWait(srvNr, reused);
+        if(res >= 0) return res;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::srvSend(WiFiClient& client, bool& reused, uint8_t srvNr, const char* objectId, const uint16_t startingIndex, const uint16_t maxCount,
+                          bool metadata, uint16_t filter, bool open){
+
+    char* id = xmlEscape(objectId); // NULL: nothing to escape
+    char range[128];
+    snprintf(range, sizeof(range), "</Filter>\r\n"
+                                   "<StartingIndex>%u</StartingIndex>\r\n"
+                                   "<RequestedCount>%u</RequestedCount>\r\n"
+                                   "<SortCriteria></SortCriteria>\r\n", startingIndex, maxCount);
+    const char* args[] = {"<ObjectID>", id ? id : objectId, "</ObjectID>\r\n<BrowseFlag>",
+                          metadata ? "BrowseMetadata" : "BrowseDirectChildren", "</BrowseFlag>\r\n<Filter>", filterString(filter), range};
+    bool res = srvSoap(client, reused, srvNr, "Browse", args, sizeof(args) / sizeof(args[0]), open);
+    if(id) free(id);
+    return res;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+char* DLNA_Client::xmlEscape(const char* str){ // copy with & < > " escaped, NULL if there is nothing to escape
+    if(!strpbrk(str, "&<>\"")) return NULL;
+    char* buf = x_ps_malloc(strlen(str) * 6 + 1);
+    if(!buf) return NULL;
+    char* p = buf;
+    for(; *str; str++){
+        if(*str == '&')      {memcpy(p, "&amp;", 5);  p += 5;}
+        else if(*str == '<') {memcpy(p, "&lt;", 4);   p += 4;}
+        else if(*str == '>') {memcpy(p, "&gt;", 4);   p += 4;}
+        else if(*str == '"') {memcpy(p, "&quot;", 6); p += 6;}
+        else *p++ = *str;
+    }
+    *p = '\0';
+    return buf;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char* DLNA_Client::filterString(uint16_t filter){ // comma separated property list, FILTER_TITLE ...
+
+    static const char* names[] = {"dc:title", "upnp:class", "res", "res@size", "res@duration", "@childCount"};
+    if(filter == FILTER_ALL) return "*";
+    m_filterStr[0] = '\0';
+    for(uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++){
+        if(!(filter & (1 << i))) continue;
+        if(m_filterStr[0]) strcat(m_filterStr, ",");
+        strcat(m_filterStr, names[i]);
+    }
+    return m_filterStr;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::srvSoap(WiFiClient& client, bool& reused, uint8_t srvNr, const char* action, const char** args, uint8_t argc, bool open){
+    // the request is a list of segments: constant text and the variable fields, sent by one gathered write
+    static const char post[]     = "POST /";
+    static const char host[]     = " HTTP/1.1\r\nHost: ";
+    static const char length[]   = "\r\nCACHE-CONTROL: no-cache\r\nPRAGMA: no-cache\r\n"
+                                   "Connection: keep-alive\r\n"
+                                   "Content-Length: ";
+    static const char soapAct[]  = "\r\nContent-Type: text/xml; charset=\"utf-8\"\r\n"
+                                   "SOAPAction: \"urn:schemas-upnp-org:service:ContentDirectory:1#";
+    static const char hdrEnd[]   = "\"\r\nUser-Agent: ESP32/Player/UPNP1.0\r\n"
+                                   "\r\n";                                          /*end header, begin message */
+    static const char envBegin[] = "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n"
+                                   "<s:Body>"
+                                   "<u:";
+    static const char actNs[]    = " xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\">\r\n";
+    static const char actEnd[]   = "</u:";
+    static const char envEnd[]   = ">\r\n"
+                                   "</s:Body>\r\n"
+                                   "</s:Envelope>\r\n\r\n";
+
+    if(argc > SOAP_MAX_ARGS) {log_e("too many arguments"); return false;}
+    uint16_t actLen = strlen(action);
+    uint32_t bodyLen = (sizeof(envBegin) - 1) + actLen + (sizeof(actNs) - 1) + (sizeof(actEnd) - 1) + actLen + (sizeof(envEnd) - 1);
+    for(uint8_t i = 0; i < argc; i++) bodyLen += strlen(args[i]);
+    char hostPort[24]; snprintf(hostPort, sizeof(hostPort), "%s:%d", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr]);
+    char contentLength[12]; snprintf(contentLength, sizeof(contentLength), "%lu", (long unsigned int)bodyLen);
+
+    struct iovec iov[15 + SOAP_MAX_ARGS];
+    uint8_t n = 0;
+    auto seg = [&](const char* p, size_t len) {iov[n].iov_base = (void*)p; iov[n].iov_len = len; n++;}; // lambda, inner function
+    seg(post, sizeof(post) - 1);
+    seg(m_dlnaServer.controlURL[srvNr], strlen(m_dlnaServer.controlURL[srvNr]));
+    seg(host, sizeof(host) - 1);
+    seg(hostPort, strlen(hostPort));
+    seg(length, sizeof(length) - 1);
+    seg(contentLength, strlen(contentLength));
+    seg(soapAct, sizeof(soapAct) - 1);
+    seg(action, actLen);
+    seg(hdrEnd, sizeof(hdrEnd) - 1);
+    seg(envBegin, sizeof(envBegin) - 1);
+    seg(action, actLen);
+    seg(actNs, sizeof(actNs) - 1);
+    for(uint8_t i = 0; i < argc; i++) seg(args[i], strlen(args[i]));
+    seg(actEnd, sizeof(actEnd) - 1);
+    seg(action, actLen);
+    seg(envEnd, sizeof(envEnd) - 1);
+
+    while(true){ // open: connOpen() first, else client is connected already (callStep())
+        if(open && !connOpen(client, srvNr, reused)) return false;
+        if(sendAll(client, iov, n)) return true;
+        client.stop();
+        if(!reused) {log_e("can't send the request to %s", hostPort); return false;}
+        if(!open) return false; // callStep() connects again
+        // a reused connection was closed by the server meanwhile, the next connOpen() connects again
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::sendAll(WiFiClient& client, const struct iovec* segments, uint8_t n){ // gathered write, repeated only if the send buffer is full
+
+    struct iovec iov[15 + SOAP_MAX_ARGS];
+    struct iovec* v = iov;
+    memcpy(iov, segments, n * sizeof(struct iovec));
+    uint32_t t = millis();
+    while(n){
+        ssize_t w = lwip_writev(client.fd(), v, n);
+        if(w < 0){
+            if((errno == EAGAIN || errno == EWOULDBLOCK) && millis() - t < READ_TIMEOUT) {vTaskDelay(1); continue;}
             return false;
         }
+        while(n && (size_t)w >= v->iov_len) {w -= v->iov_len; v++; n--;}
+        if(n) {v->iov_base = (char*)v->iov_base + w; v->iov_len -= w;}
     }
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::srvWait(uint8_t srvNr, bool reused){ // 1: the response arrives, 0: error, -1: reused connection closed, try again
 
-    sprintf(m_chbuf, "POST /%s HTTP/1.1\r\n"                                                                                                         \
-                     "Host: %s:%d\r\n"                                                                                                               \
-                     "CACHE-CONTROL: no-cache\r\nPRAGMA: no-cache\r\n"                                                                               \
-                     "Connection: close\r\n"                                                                                                         \
-                     "Content-Length: 000\r\n"                         /* dummy length, determine later*/                                            \
-                     "Content-Type: text/xml; charset=\"utf-8\"\r\n"                                                                                 \
-                     "SOAPAction: \"urn:schemas-upnp-org:service:ContentDirectory:1#Browse\"\r\n"                                                    \
-                     "User-Agent: ESP32/Player/UPNP1.0\r\n"                                                                                          \
-                     "\r\n"                                            /*end header, begin message */                                                \
-                     "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">\r\n"\
-                     "<s:Body>"                                                                                                                      \
-                     "<u:Browse xmlns:u=\"urn:schemas-upnp-org:service:ContentDirectory:1\">\r\n"                                                    \
-                     "<ObjectID>%s</ObjectID>\r\n"                                                                                                   \
-                     "<BrowseFlag>BrowseDirectChildren</BrowseFlag>\r\n"                                                                             \
-                     "<Filter>*</Filter>\r\n"                                                                                                        \
-                     "<StartingIndex>%i</StartingIndex>\r\n"           /* startingIndex */                                                           \
-                     "<RequestedCount>%i</RequestedCount>\r\n"         /* max count*/                                                                \
-                     "<SortCriteria></SortCriteria>\r\n"                                                                                             \
-                     "</u:Browse>\r\n"                                                                                                               \
-                     "</s:Body>\r\n"                                                                                                                 \
-                     "</s:Envelope>\r\n\r\n"
-                     , m_dlnaServer.controlURL[srvNr], m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], objectId, startingIndex, maxCount);
-
-    uint16_t msgBegin = indexOf(m_chbuf, "\r\n\r\n", 0);
-    uint16_t msgLength = strlen(m_chbuf) - (msgBegin + 4);
-    uint16_t insertIdx = indexOf(m_chbuf, "Content-Length:", 0) + 16;
-    char tmp[10]; itoa(msgLength, tmp, 10);
-    memcpy(m_chbuf + insertIdx, tmp, 3);
-    m_chbuf[strlen(m_chbuf)+ 1] = '\0';
-
-    m_client.print(m_chbuf);
-
-    t = millis() + AVAIL_TIMEOUT;
+    uint32_t t = millis() + AVAIL_TIMEOUT;
     while(true){
-        if(m_client.available()) break;
+        if(m_client.available()) return 1;
+        if(m_cancel && !m_crawlRun) {m_client.stop(); return 0;} // cancelRequest()
+        if(reused && !m_client.connected()) {m_client.stop(); return -1;} // closed by the server, try again with a new connection
         if(t < millis()){
+            m_client.stop();
             sprintf(m_chbuf, "The server %s:%d is not responding after request [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], __FILENAME__, __LINE__);
-            if(dlna_info) dlna_info(m_chbuf);
-            return false;
+            cbInfo(m_chbuf);
+            return 0;
         }
+        vTaskDelay(1); // the server needs some time, other tasks go on meanwhile
     }
-    return true;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 int8_t DLNA_Client::browseServer(uint8_t srvNr, const char* objectId, const uint16_t startingIndex, const uint16_t maxCount){
     if(!objectId) {log_e("objectId is NULL"); return -1;} // no objectId given
     if(srvNr >= m_dlnaServer.size) {log_e("server index too high"); return -2;} // srvNr too high
+    if(strcmp(m_dlnaServer.controlURL[srvNr], "?") == 0) {log_e("server description not read yet"); return -2;}
     if(m_state != IDLE) {log_e("state is not idle"); return -3;}
 
     m_srvNr = srvNr;
-    strcpy(m_objectId, objectId);
+    if(m_objectId) free(m_objectId);
+    m_objectId = x_ps_strdup(objectId);
     m_startingIndex = startingIndex;
     m_maxCount = maxCount;
+    m_paged = false;
+    m_metadata = false;
     m_state = BROWSE_SERVER;
     return 0;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-const char* DLNA_Client::stringifyServer() {
-    if(m_dlnaServer.size == 0) return "[]"; // guard
+int8_t DLNA_Client::browseServerAll(uint8_t srvNr, const char* objectId, const uint16_t pageSize){ // all children, page by page
+    if(pageSize == 0) {log_e("pageSize is 0"); return -1;}
+    int8_t res = browseServer(srvNr, objectId, 0, pageSize);
+    if(res < 0) return res;
+    m_paged = true;
+    m_pageTotal = 0;
+    m_pageDelivered = 0;
+    return 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::getObjectMetadata(uint8_t srvNr, const char* objectId){ // one item or container, e.g. to refresh a stale itemURL
+    int8_t res = browseServer(srvNr, objectId, 0, 0);
+    if(res < 0) return res;
+    m_metadata = true;
+    return 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::prefetchPage(uint16_t startingIndex){ // the request of the next page is sent before the current page is parsed
+    if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;}
+    if(!srvSend(m_prefetch, m_prefetchReused, m_srvNr, m_objectId, startingIndex, m_maxCount, m_metadata, m_filter)) return false;
+    m_prefetchStart = startingIndex;
+    m_prefetchActive = true;
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+namespace { // local to this file
+class BufferPrint : public Print { // Print into a memory buffer, len counts everything, also what did not fit (NULL, 0: count only)
+public:
+    BufferPrint(uint8_t* buf, size_t size) : m_buf(buf), m_size(size) {}
+    size_t len = 0;
+    size_t write(uint8_t c) override {return write(&c, 1);}
+    size_t write(const uint8_t* buf, size_t size) override {
+        if(len < m_size) memcpy(m_buf + len, buf, (m_size - len < size) ? m_size - len : size);
+        len += size;
+        return size;
+    }
+private:
+    uint8_t* m_buf;
+    size_t   m_size;
+};
+} // namespace
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+size_t DLNA_Client::printServer(Print& out){ // the server table as JSON, written piece by piece to any Print (Serial, File, WiFiClient ...)
+    // [{"srvId":"1","friendlyName":"minidlna","ip":"192.168.178.1","port":"49000"}]
+    printBuf_t j(out);
+    char num[8];
+    bufPut(j, "[");
+    for(int i = 0; i < m_dlnaServer.size; i++) {
+        bufPut(j, i ? ",{\"srvId\":\"" : "{\"srvId\":\""); itoa(i, num, 10); bufPut(j, num);
+        bufPut(j, "\",\"friendlyName\":\""); jsonStr(j, m_dlnaServer.friendlyName[i]);
+        bufPut(j, "\",\"ip\":\""); jsonStr(j, m_dlnaServer.ip[i]);
+        bufPut(j, "\",\"port\":\""); itoa(m_dlnaServer.port[i], num, 10); bufPut(j, num);
+        bufPut(j, "\"}");
+    }
+    bufPut(j, "]");
+    bufFlush(j);
+    return j.total;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+size_t DLNA_Client::printContent(Print& out, uint16_t first, uint16_t count){ // the browse result or a part of it as JSON
+    // [{"objectId":"1$4","parentId":"1","childCount":"5","title":"Bilder","isAudio":"false","itemSize":"342345","dur":"?","itemURL":"http://myPC/Pictues/myPicture.jpg"},{"objectId ...."}]
+    printBuf_t j(out);
+    char num[12];
+    uint32_t last = (uint32_t)first + count;
+    if(last > m_recordCount) last = m_recordCount;
+    bufPut(j, "[");
+    for(uint32_t i = first; i < last; i++) {
+        contentItem_t c = getItem(i);
+        bufPut(j, i > first ? ",{\"objectId\":\"" : "{\"objectId\":\""); jsonStr(j, c.objectId);
+        bufPut(j, "\",\"parentId\":\""); jsonStr(j, c.parentId);
+        bufPut(j, "\",\"childCount\":\""); itoa(c.childCount, num, 10); bufPut(j, num);
+        bufPut(j, "\",\"title\":\""); jsonStr(j, c.title);
+        bufPut(j, "\",\"isAudio\":\""); bufPut(j, c.isAudio ? "true" : "false");
+        bufPut(j, "\",\"itemSize\":\""); ultoa(c.itemSize, num, 10); bufPut(j, num);
+        bufPut(j, "\",\"dur\":\""); jsonStr(j, c.duration);
+        bufPut(j, "\",\"itemURL\":\""); jsonStr(j, c.itemURL);
+        bufPut(j, "\"}");
+    }
+    bufPut(j, "]");
+    bufFlush(j);
+    return j.total;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::bufPut(printBuf_t& j, const char* str, uint32_t len){ // raw text, collected in j.buf so that a socket gets no tiny writes
+    if(len == UINT32_MAX) len = strlen(str);
+    if(j.len + len > sizeof(j.buf)) bufFlush(j);
+    if(len > sizeof(j.buf)) {j.total += j.out.write((const uint8_t*)str, len); return;}
+    memcpy(j.buf + j.len, str, len);
+    j.len += len;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::jsonStr(printBuf_t& j, const char* str){ // string value, " \ and control characters escaped, UTF-8 unchanged
+    const char* run = str; // characters that need no escape are written in one piece
+    char esc[8];
+    for(; *str; str++){
+        uint8_t c = *str;
+        if(c >= 0x20 && c != '"' && c != '\\') continue;
+        bufPut(j, run, str - run);
+        run = str + 1;
+        if     (c == '"')  bufPut(j, "\\\"", 2);
+        else if(c == '\\') bufPut(j, "\\\\", 2);
+        else if(c == '\n') bufPut(j, "\\n", 2);
+        else if(c == '\r') bufPut(j, "\\r", 2);
+        else if(c == '\t') bufPut(j, "\\t", 2);
+        else {sprintf(esc, "\\u%04x", c); bufPut(j, esc, 6);}
+    }
+    bufPut(j, run, str - run);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::bufFlush(printBuf_t& j){
+    if(j.len) j.total += j.out.write((const uint8_t*)j.buf, j.len);
+    j.len = 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+size_t DLNA_Client::cborServer(Print& out){ // the server table as CBOR (RFC 8949), [[srvId, friendlyName, ip, port], ...]
+    printBuf_t j(out);
+    cborHead(j, 4, m_dlnaServer.size);
+    for(int i = 0; i < m_dlnaServer.size; i++){
+        cborHead(j, 4, 4);
+        cborHead(j, 0, i);
+        cborText(j, m_dlnaServer.friendlyName[i]);
+        cborText(j, m_dlnaServer.ip[i]);
+        cborHead(j, 0, m_dlnaServer.port[i]);
+    }
+    bufFlush(j);
+    return j.total;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+size_t DLNA_Client::cborContent(Print& out, uint16_t first, uint16_t count){ // the browse result as CBOR, see the header for the layout
 
-    uint16_t JSONstrLength = 0;
+    const char* prefix[CBOR_PREFIXES]; // URL prefixes sent so far, up to the last '/'
+    uint16_t    prefixLen[CBOR_PREFIXES];
+    uint8_t     prefixes = 0;
+    printBuf_t j(out);
+    uint32_t last = (uint32_t)first + count;
+    if(last > m_recordCount) last = m_recordCount;
+    cborHead(j, 4, last > first ? last - first : 0);
+    for(uint32_t i = first; i < last; i++){
+        contentItem_t c = getItem(i);
+        cborHead(j, 4, 8);
+        cborText(j, c.objectId);
+        cborText(j, c.parentId);
+        cborHead(j, 0, c.childCount);
+        cborText(j, c.title);
+        bufPut(j, c.isAudio ? "\xF5" : "\xF4", 1);                          // true, false
+        cborHead(j, 0, c.itemSize);
+        int32_t ms = durationMs(c.duration);
+        if(ms < 0) bufPut(j, "\xF6", 1); else cborHead(j, 0, ms);             // null if unknown
+        const char* slash = strrchr(c.itemURL, '/');
+        if(!startsWith(c.itemURL, "http") || !slash) {if(c.itemURL[0] == '?') bufPut(j, "\xF6", 1); else cborText(j, c.itemURL); continue;}
+        uint16_t len = slash + 1 - c.itemURL;
+        uint8_t p = 0;
+        while(p < prefixes && (prefixLen[p] != len || memcmp(prefix[p], c.itemURL, len) != 0)) p++;
+        if(p < prefixes){                                                    // [index, suffix]
+            cborHead(j, 4, 2); cborHead(j, 0, p); cborText(j, c.itemURL + len);
+        }
+        else if(prefixes < CBOR_PREFIXES){                                   // [index, prefix, suffix], defines the prefix
+            prefix[prefixes] = c.itemURL; prefixLen[prefixes] = len;
+            cborHead(j, 4, 3); cborHead(j, 0, prefixes++); cborText(j, c.itemURL, len); cborText(j, c.itemURL + len);
+        }
+        else cborText(j, c.itemURL);                                         // table full
+    }
+    bufFlush(j);
+    return j.total;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+size_t DLNA_Client::cborServer(uint8_t* buf, size_t size){ // returns the length of the whole encoding, only size bytes are written
+    BufferPrint p(buf, size);
+    cborServer(p);
+    return p.len;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+size_t DLNA_Client::cborContent(uint8_t* buf, size_t size, uint16_t first, uint16_t count){
+    BufferPrint p(buf, size);
+    cborContent(p, first, count);
+    return p.len;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cborHead(printBuf_t& j, uint8_t major, uint32_t val){ // major type and argument, shortest form
+    uint8_t b[5];
+    major <<= 5;
+    if(val < 24)          {b[0] = major | val; bufPut(j, (const char*)b, 1); return;}
+    if(val <= 0xFF)       {b[0] = major | 24; b[1] = val; bufPut(j, (const char*)b, 2); return;}
+    if(val <= 0xFFFF)     {b[0] = major | 25; b[1] = val >> 8; b[2] = val; bufPut(j, (const char*)b, 3); return;}
+    b[0] = major | 26; b[1] = val >> 24; b[2] = val >> 16; b[3] = val >> 8; b[4] = val;
+    bufPut(j, (const char*)b, 5);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cborText(printBuf_t& j, const char* str, uint32_t len){ // UTF-8 text string
+    if(len == UINT32_MAX) len = strlen(str);
+    cborHead(j, 3, len);
+    bufPut(j, str, len);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int32_t DLNA_Client::durationMs(const char* duration){ // "H:MM:SS" or "H:MM:SS.fff" -> ms, -1 if unknown
+    unsigned int h, m; float sec;
+    if(sscanf(duration, "%u:%u:%f", &h, &m, &sec) != 3) return -1;
+    return (h * 3600 + m * 60) * 1000 + (uint32_t)(sec * 1000 + 0.5f);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+const char* DLNA_Client::stringifyServer() { // printServer() into m_JSONstr, measured first so that one malloc is enough
     if(m_JSONstr){free(m_JSONstr); m_JSONstr = NULL;}
-    if(m_dlnaServer.size == 0) return "[]"; // no content found
-    if(m_PSRAMfound) { m_JSONstr = (char*)ps_malloc(2);}
-    else             { m_JSONstr = (char*)malloc(2);}
-    JSONstrLength += 2;
-    memcpy(m_JSONstr, "[\0", 2);
-
-    char id[5]; char port[6];
-
-    for(int i = 0; i < m_dlnaServer.size; i++) { // build a JSON string in PSRAM, e.g. [{"name":"m","dir":true},{"name":"s","dir":false}]
-        itoa(i, id, 10);
-        itoa(m_dlnaServer.port[i], port, 10);
-        JSONstrLength = strlen(id) + strlen(port) + strlen(m_dlnaServer.friendlyName[i])+ strlen(m_dlnaServer.ip[i]);
-    //  [{"srvId":"1","friendlyName":"minidlna","ip":"192.168.178.1","port":"49000""}]
-    //  {"srvId":"","friendlyName":"","ip":"","port":""},   --> 49 chars
-        JSONstrLength += strlen(m_JSONstr) + 49 + 2;
-
-        if(m_PSRAMfound) { m_JSONstr = (char*)ps_realloc(m_JSONstr, JSONstrLength); }
-        else             { m_JSONstr = (char*)realloc(m_JSONstr, JSONstrLength); }
-
-        strcat(m_JSONstr, "{\"srvId\":\""); strcat(m_JSONstr, id);
-        strcat(m_JSONstr, "\",\"friendlyName\":\""); strcat(m_JSONstr, m_dlnaServer.friendlyName[i]);
-        strcat(m_JSONstr, "\",\"ip\":\""); strcat(m_JSONstr, m_dlnaServer.ip[i]);
-        strcat(m_JSONstr, "\",\"port\":\""); strcat(m_JSONstr, port);
-        strcat(m_JSONstr, "\"},");
-    }
-    m_JSONstr[JSONstrLength - 3] = ']'; // replace comma by square bracket close
-    m_JSONstr[JSONstrLength - 2] = '\0'; // and terminate
+    if(m_dlnaServer.size == 0) return "[]"; // no server found
+    BufferPrint cnt(NULL, 0);
+    printServer(cnt);
+    m_JSONstr = x_ps_malloc(cnt.len + 1);
+    if(!m_JSONstr) return "[]";
+    BufferPrint buf((uint8_t*)m_JSONstr, cnt.len);
+    printServer(buf);
+    m_JSONstr[cnt.len] = '\0';
     return m_JSONstr;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-const char* DLNA_Client::stringifyContent() {
-    if(m_srvContent.size == 0) return "[]"; // guard
-
-    uint16_t JSONstrLength = 0;
+const char* DLNA_Client::stringifyContent() { // printContent() into m_JSONstr
     if(m_JSONstr){free(m_JSONstr); m_JSONstr = NULL;}
-    if(m_srvContent.size == 0) return "[]"; // no content found
-    if(m_PSRAMfound) { m_JSONstr = (char*)ps_malloc(2);}
-    else             { m_JSONstr = (char*)malloc(2);}
-    JSONstrLength += 2;
-    memcpy(m_JSONstr, "[\0", 2);
-
-    char childCount[5]; char isAudio[6]; char itemSize[12];
-
-    for(int i = 0; i < m_srvContent.size; i++) { // build a JSON string in PSRAM, e.g. [{"name":"m","dir":true},{"name":"s","dir":false}]
-        itoa(m_srvContent.childCount[i], childCount, 10);
-        if(m_srvContent.isAudio[i]) strcpy(isAudio, "true"); else strcpy(isAudio, "false");
-        ltoa(m_srvContent.itemSize[i], itemSize, 10);
-        JSONstrLength = strlen(childCount) + strlen(isAudio) + strlen(itemSize) + strlen(m_srvContent.itemURL[i])+
-                        strlen(m_srvContent.objectId[i]) + strlen(m_srvContent.parentId[i]) + strlen(m_srvContent.title[i]) + strlen(m_srvContent.duration[i]);
-
-    //  [{"objectId":"1$4","parentId":"1","childCount":"5","title":"Bilder","isAudio":"false","itemSize":"342345","itemURL":"http://myPC/Pictues/myPicture.jpg"},{"objectId ...."}]
-    //  {"objectId":"","parentId":"","childCount":"","title":"","isAudio":"","itemSize":"","dur:"","itemURL":""},   --> 105 chars
-        JSONstrLength += strlen(m_JSONstr) + 105 + 2;
-
-        if(m_PSRAMfound) { m_JSONstr = (char*)ps_realloc(m_JSONstr, JSONstrLength); }
-        else             { m_JSONstr = (char*)realloc(m_JSONstr, JSONstrLength); }
-
-        strcat(m_JSONstr, "{\"objectId\":\""); strcat(m_JSONstr, m_srvContent.objectId[i]);
-        strcat(m_JSONstr, "\",\"parentId\":\""); strcat(m_JSONstr, m_srvContent.parentId[i]);
-        strcat(m_JSONstr, "\",\"childCount\":\""); strcat(m_JSONstr, childCount);
-        strcat(m_JSONstr, "\",\"title\":\""); strcat(m_JSONstr, m_srvContent.title[i]);
-        strcat(m_JSONstr, "\",\"isAudio\":\""); strcat(m_JSONstr, isAudio);
-        strcat(m_JSONstr, "\",\"itemSize\":\""); strcat(m_JSONstr, itemSize);
-        strcat(m_JSONstr, "\",\"dur\":\""); strcat(m_JSONstr, m_srvContent.duration[i]);
-        strcat(m_JSONstr, "\",\"itemURL\":\""); strcat(m_JSONstr, m_srvContent.itemURL[i]);
-        strcat(m_JSONstr, "\"},");
-    }
-    m_JSONstr[JSONstrLength - 2] = ']';  // replace comma by square bracket close
-    m_JSONstr[JSONstrLength - 1] = '\0'; // and terminate
+    if(m_recordCount == 0) return "[]"; // no content found
+    BufferPrint cnt(NULL, 0);
+    printContent(cnt);
+    m_JSONstr = x_ps_malloc(cnt.len + 1);
+    if(!m_JSONstr) return "[]";
+    BufferPrint buf((uint8_t*)m_JSONstr, cnt.len);
+    printContent(buf);
+    m_JSONstr[cnt.len] = '\0';
     return m_JSONstr;
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -751,56 +2438,583 @@ uint8_t DLNA_Client::getState(){
 }
 //------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 void DLNA_Client::loop(){
-    static uint8_t cnt = 0;
-    static uint8_t fail = 0;
     bool res;
+    if(m_task && xTaskGetCurrentTaskHandle() != m_task) return; // startTask(), the task calls loop()
+    m_loopStart = micros();
+    if(m_cancel && (m_state == BROWSE_SERVER || m_state == SEARCH_SERVER)) browseAbort(); // cancelRequest() between two pages or steps
+    if(m_notifyEnabled){
+        while(true){
+            int len = m_udpNotify.parsePacket();
+            if(len <= 0) break;
+            parseNotify(len);
+        }
+    }
+    if(m_verifyActive){
+        while(true){ // answers to the unicast M-SEARCH of loadServerCache()
+            int len = m_udp.parsePacket();
+            if(len <= 0) break;
+            if(len > m_chbufSize - 1) len = m_chbufSize - 1; // guard
+            memset(m_chbuf, 0, m_chbufSize);
+            m_udp.read(m_chbuf, len);
+            int16_t idx = registerServer(m_chbuf);
+            if(idx < 0) continue;
+            m_verified |= (1UL << idx);
+            if(strcmp(m_dlnaServer.controlURL[idx], "?") == 0) m_resolvePending = true; // new location
+        }
+        if(m_ssdpSent < SSDP_RETRANSMITS && millis() - m_timeStamp >= m_ssdpSent * SSDP_RETRANSMIT_INTERVAL){
+            for(uint8_t i = 0; i < m_dlnaServer.size; i++){
+                if(!(m_verified & (1UL << i))) sendMSearch(m_dlnaServer.ip[i]);
+            }
+            m_ssdpSent++;
+        }
+    }
+    if(m_state == IDLE && !m_reqHandle) requestStart(); // queued requests, see requestBrowse()
+    if(m_crawlPage && m_state != IDLE) crawlAbort();
     switch(m_state){
         case IDLE:
+            if(m_notifyEnabled) checkServerExpiry();
+            if(m_verifyActive){
+                uint32_t all = (m_dlnaServer.size >= 32) ? 0xFFFFFFFF : (1UL << m_dlnaServer.size) - 1;
+                if((m_verified & all) == all || millis() - m_timeStamp > VERIFY_TIMEOUT) finishVerify();
+            }
+            if(m_resolvePending){ // a new server has announced itself
+                m_resolvePending = false;
+                m_fetchNext = 0;
+                m_state = GET_SERVER_ITEMS;
+                break;
+            }
+            if(m_crawlActive && (m_crawlPage || m_idx.phase != IDX_OFF || millis() - m_crawlLast >= CRAWL_INTERVAL)) crawlStep(); // background, one page at a time
             break;
         case SEEK_SERVER:
-            if(m_timeStamp + SEEK_TIMEOUT > millis()){
+            m_fetchNext = 0;
+            while(true){ // take all datagrams that have arrived since the last call
                 int len = m_udp.parsePacket();
-                if(len > 0){
-                    parseDlnaServer(len); // registers all media servers that respond within the time until the timeout
-                }
-                cnt = 0;
-                fail = 0;
+                if(len <= 0) break;
+                parseDlnaServer(len); // registers all media servers that respond within the search window
             }
-            else{
+            if(seekComplete()){ // all expected servers are there, don't wait for MX
                 m_udp.stop();
                 m_state = GET_SERVER_ITEMS;
+                break;
+            }
+            if(millis() - m_timeStamp > m_seekWindow){
+                m_udp.stop();
+                m_state = GET_SERVER_ITEMS;
+                break;
+            }
+            if(m_ssdpSent < SSDP_RETRANSMITS && millis() - m_ssdpLastTx >= SSDP_RETRANSMIT_INTERVAL){
+                sendMSearch(); // UDP is unreliable, repeat the request
             }
             break;
         case GET_SERVER_ITEMS:
-            if(cnt < m_dlnaServer.size){
-                if(fail == 3) {fail = 0; log_e("no response from svr [%i]", cnt); cnt++; break;}
-                res = srvGet(cnt);
-                if(!res){/* log_e("error in srvGet"); m_state = IDLE; */ fail++; break;}
-                res = readHttpHeader();
-                if(!res){/* log_e("error in readHttpHeader");  m_state = IDLE;*/ fail++; break;}
-                res = readContent();
-                if(!res){/* log_e("error in readContent"); m_state = IDLE; */ fail++; break;}
-                res = getServerItems(cnt);
-                if(!res){/* log_e("error in readContent"); m_state = IDLE; */ fail++; break;}
-                cnt++;
-                break;
+            if(!fetchServerItems()) break; // each server is reported by dlna_server() as soon as its description is there
+            m_fetchNext = 0;
+            for(int16_t i = m_dlnaServer.size - 1; i >= 0; i--){ // cached server, no answer to M-SEARCH and GET
+                if((m_probing & (1UL << i)) && strcmp(m_dlnaServer.controlURL[i], "?") == 0) removeServer(i);
             }
-            cnt = 0;
-            dlna_seekReady(m_dlnaServer.size);
-            m_state = IDLE;
+            m_probing = 0;
+            if(m_seekActive && m_cacheEnabled) saveServerCache();
+            m_state = IDLE; // the getters work in dlna_seekReady()
+            if(m_seekActive) {m_seekActive = false; cbSeekReady();}
+            break;
+        case SEARCH_SERVER:
+            if(m_loopBudget || m_loopBytes) {browseStep(); break;} // setLoopBudget(), in pieces
+            if(!search()) {m_numberReturned = 0; m_totalMatches = 0;}
+            m_state = IDLE; // before the callback, the getters work and a new request is accepted there
+            cbBrowseReady();
             break;
         case BROWSE_SERVER:
-            res = srvPost(m_srvNr, m_objectId, m_startingIndex, m_maxCount);
-            if(!res){m_state = IDLE; break;}
-            res = readHttpHeader();
-            if(!res) {m_state = IDLE; break;}
-            res = readContent();
-            if(!res) {m_state = IDLE; break;}
-            res = browseResult();
-            if(!res) {m_state = IDLE; break;}
-            cnt = 0;
-            m_state = IDLE;
+            if(m_loopBudget || m_loopBytes) {browseStep(); break;}
+            if(!m_paged && !m_metadata && m_cacheBudget && browseCached()){ // answered from the browse cache
+                if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;} // sent ahead, not needed
+                m_state = IDLE;
+                cbBrowseReady();
+                break;
+            }
+            if(m_prefetchActive && m_prefetchStart == m_startingIndex){ // the request is already on the way
+                int8_t r;
+                m_client = m_prefetch;
+                m_prefetch.stop();
+                m_prefetchActive = false;
+                r = srvWait(m_srvNr, m_prefetchReused);
+                res = (r > 0) || (r < 0 && srvPost(m_srvNr, m_objectId, m_startingIndex, m_maxCount, m_metadata, m_filter));
+            }
+            else res = srvPost(m_srvNr, m_objectId, m_startingIndex, m_maxCount, m_metadata, m_filter);
+            if(res) res = readHttpHeader();
+            if(res) prefetchNext(); // the server prepares the next page while this one is parsed
+            if(res) res = readContent();
+            browseDone(res);
             break;
         default: break;
     }
+    if(m_reqHandle && m_state == IDLE) requestFinish();
+    uint32_t t = micros() - m_loopStart;
+    if(t > m_loopMax) m_loopMax = t;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::browseDone(bool res){ // the page is read, res: without error
+    connRelease(res, m_srvNr);
+    if(res && m_captureOn) cacheInsert();
+    m_captureOn = false;
+    if(!res) {
+        if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;}
+        m_state = IDLE;
+        return;
+    }
+    if(m_paged){
+        bool more;
+        uint32_t next = m_startingIndex + m_numberReturned;
+        if(m_startingIndex == 0 && m_numberReturned && m_numberReturned < m_maxCount && m_numberReturned < m_totalMatches){
+            m_maxCount = m_numberReturned; // the server limits the page size
+        }
+        m_pageDelivered += m_numberReturned;
+        m_pageTotal = m_totalMatches;
+        if(m_pageTotal) more = m_numberReturned && next < m_pageTotal;
+        else            more = m_numberReturned == m_maxCount; // TotalMatches not given
+        if(more && next <= 0xFFFF){
+            m_startingIndex = next;
+            if((!m_prefetchActive || m_prefetchStart != next) && (!(m_loopBudget || m_loopBytes) || connIdle(m_srvNr))){
+                prefetchPage(next); // the application gets control, the server works meanwhile
+            }
+            return;
+        }
+        if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;}
+        m_numberReturned = m_pageDelivered;
+    }
+    m_state = IDLE;
+    cbBrowseReady();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::prefetchNext(){ // browseServerAll(), the next page is requested before this one is parsed
+    if(m_paged && m_pageTotal && m_startingIndex + m_maxCount < m_pageTotal) prefetchPage(m_startingIndex + m_maxCount);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::browseStep(){ // BROWSE_SERVER and SEARCH_SERVER in steps that don't wait, setLoopBudget()
+
+    bool search = (m_state == SEARCH_SERVER);
+    uint32_t sysId = 0;
+    int8_t r;
+    if(m_step == STEP_START){
+        m_captureOn = false;
+        m_callSrv = m_srvNr;
+        m_stepAttempt = 0;
+        m_timeStamp = millis();
+        if(!search && !m_paged && !m_metadata && m_cacheBudget){ // browse cache, validated by the SystemUpdateID
+            r = systemUpdateIdKnown(m_srvNr, sysId);
+            if(r < 0) {m_call = CALL_SYSID; m_step = STEP_CONNECT; return;}
+            if(r > 0 && cacheLookup(sysId)) goto cached;
+        }
+        if(search && !getSearchCapabilities(m_srvNr)) {m_call = CALL_CAPS; m_step = STEP_CONNECT; return;}
+        browseCall();
+        return;
+    }
+    r = callStep();
+    if(r == 0) return; // next loop()
+    if(m_call == CALL_SYSID){
+        connRelease(r > 0, m_srvNr);
+        if(systemUpdateIdStore(m_srvNr, r > 0, sysId) && cacheLookup(sysId)) goto cached;
+        browseCall();
+        return;
+    }
+    if(m_call == CALL_CAPS){
+        connRelease(r > 0, m_srvNr);
+        searchCapsStore(m_srvNr, r > 0);
+        browseCall();
+        return;
+    }
+    if(!search) {browseDone(r > 0); return;}
+    connRelease(r > 0, m_srvNr);
+    if(r < 0) {m_numberReturned = 0; m_totalMatches = 0;}
+    m_state = IDLE;
+    cbBrowseReady();
+    return;
+
+cached: // answered from the browse cache
+    if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;}
+    m_state = IDLE;
+    cbBrowseReady();
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::browseCall(){ // the Browse or Search itself, after GetSystemUpdateID or GetSearchCapabilities if needed
+
+    m_stepAttempt = 0;
+    m_timeStamp = millis();
+    if(m_state == SEARCH_SERVER){
+        if(!searchCheck(getSearchCapabilities(m_srvNr))){
+            m_numberReturned = 0;
+            m_totalMatches = 0;
+            m_state = IDLE;
+            cbBrowseReady();
+            return;
+        }
+        m_call = CALL_SEARCH;
+        m_step = STEP_CONNECT;
+        return;
+    }
+    m_call = CALL_BROWSE;
+    if(m_prefetchActive && m_prefetchStart == m_startingIndex){ // the request is already on the way
+        m_client = m_prefetch;
+        m_prefetch.stop();
+        m_prefetchActive = false;
+        m_stepReused = m_prefetchReused;
+        m_step = STEP_WAIT;
+        return;
+    }
+    m_step = STEP_CONNECT;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int8_t DLNA_Client::callStep(){ // STEP_CONNECT ... STEP_BODY of m_call, 1: done, -1: error, 0: not yet, call again
+
+    uint8_t srvNr = m_callSrv;
+    int8_t r;
+    switch(m_step){
+        case STEP_CONNECT:
+            if(m_stepFd < 0){
+                if(connTake(m_client, srvNr)) {m_stepReused = true; m_step = STEP_SEND; return 0;} // keep-alive
+                m_stepFd = tcpConnectStart(m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr]);
+                if(m_stepFd < 0) goto error;
+                m_timeStamp = millis();
+            }
+            r = tcpConnectPoll(m_stepFd);
+            if(r == 0 && millis() - m_timeStamp < CONNECT_TIMEOUT) return 0;
+            if(r <= 0){
+                sprintf(m_chbuf, "The server %s:%d is not responding after %lums [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], (long unsigned int)(millis() - m_timeStamp), __FILENAME__, __LINE__);
+                cbInfo(m_chbuf);
+                goto error;
+            }
+            m_client = WiFiClient(m_stepFd); // WiFiClient owns the socket now
+            m_stepFd = -1;
+            m_stepReused = false;
+            m_step = STEP_SEND;
+            return 0;
+        case STEP_SEND:
+            if(!callSend()){
+                if(m_stepReused && ++m_stepAttempt < 2) {m_step = STEP_CONNECT; return 0;} // closed by the server meanwhile
+                goto error;
+            }
+            m_timeStamp = millis();
+            m_step = STEP_WAIT;
+            return 0; // the server needs some time anyway
+        case STEP_WAIT:
+            if(!m_client.available()){
+                if(m_stepReused && !m_client.connected()){ // closed by the server meanwhile, again with a new connection
+                    m_client.stop();
+                    if(++m_stepAttempt >= 2) goto error;
+                    m_step = STEP_CONNECT;
+                    return 0;
+                }
+                if(millis() - m_timeStamp < AVAIL_TIMEOUT) return 0;
+                sprintf(m_chbuf, "The server %s:%d is not responding after request [%s:%d]", m_dlnaServer.ip[srvNr], m_dlnaServer.port[srvNr], __FILENAME__, __LINE__);
+                cbInfo(m_chbuf);
+                goto error;
+            }
+            if(!headerStart()) goto error;
+            m_step = STEP_HEADER;
+            /* fall through */
+        case STEP_HEADER:
+            r = headerStep(true);
+            if(r == 0) return 0;
+            if(r < 0) goto error;
+            if(m_call == CALL_BROWSE && connIdle(srvNr)) prefetchNext(); // only without a new connect
+            if(m_call == CALL_BROWSE || m_call == CALL_SEARCH) contentStart();
+            else bodyStart(); // the result of the application stays, the crawler gets the items through crawlItem()
+            m_step = STEP_BODY;
+            return 0;
+        case STEP_BODY:
+            r = bodyStep(true);
+            if(r == 0) return 0;
+            if(m_call == CALL_BROWSE || m_call == CALL_SEARCH) contentEnd();
+            m_step = STEP_START;
+            if(r > 0 && m_call != CALL_SYSID && m_call != CALL_CAPS && !statusOk(srvNr)) return -1;
+            return r;
+    }
+
+error:
+    if(m_stepFd >= 0) {close(m_stepFd); m_stepFd = -1;}
+    m_client.stop();
+    m_step = STEP_START;
+    return -1;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::callSend(){ // STEP_SEND, m_client is connected already
+    uint8_t srvNr = m_callSrv;
+    switch(m_call){
+        case CALL_SEARCH: return searchSend(false);
+        case CALL_CRAWL:  return srvSend(m_client, m_stepReused, srvNr, m_crawlId, m_crawl.startingIndex, CRAWL_PAGE, false, FILTER_MINIMAL, false);
+        case CALL_SYSID:  return srvSoap(m_client, m_stepReused, srvNr, "GetSystemUpdateID", NULL, 0, false);
+        case CALL_CAPS:   m_searchCapsBuf[0] = '\0';
+                          return srvSoap(m_client, m_stepReused, srvNr, "GetSearchCapabilities", NULL, 0, false);
+    }
+    return srvSend(m_client, m_stepReused, srvNr, m_objectId, m_startingIndex, m_maxCount, m_metadata, m_filter, false);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::browseAbort(){ // cancelRequest(), also in the middle of browseStep()
+    if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;}
+    if(m_stepFd >= 0) {close(m_stepFd); m_stepFd = -1;}
+    m_client.stop();
+    m_captureOn = false;
+    m_step = STEP_START;
+    m_state = IDLE;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::budgetUsed(uint32_t bytes){ // setLoopBudget(), true: loop() has to return
+    if(m_loopBytes && bytes >= m_loopBytes) return true;
+    return m_loopBudget && micros() - m_loopStart >= m_loopBudget;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::setLoopBudget(uint32_t us, uint32_t bytes){ // a Browse or Search goes on in the next loop() call when one is used up
+    if(m_state == BROWSE_SERVER || m_state == SEARCH_SERVER) {log_e("not while browsing"); return;}
+    m_loopBudget = us;
+    m_loopBytes = bytes;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::getLoopMax(bool reset){ // the worst case, us
+    uint32_t t = m_loopMax;
+    if(reset) m_loopMax = 0;
+    return t;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::startTask(UBaseType_t priority, uint32_t stackSize, BaseType_t core){ // loop() runs in its own task, requests go through requestBrowse() ...
+    if(m_task) return true;
+    if(!m_mutex) m_mutex = xSemaphoreCreateRecursiveMutex();
+    if(!m_mutex) {log_e("oom"); return false;}
+    m_taskStop = false;
+    if(xTaskCreatePinnedToCore(taskFunc, "dlna", stackSize, this, priority, &m_task, core) != pdPASS){
+        m_task = NULL;
+        log_e("can't create the task");
+        return false;
+    }
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::stopTask(uint32_t waitMs){ // the running step is finished, queued requests wait for loop(), false: the task is still running
+    if(!m_task) return true;
+    m_taskStop = true;
+    xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+    if(m_reqHandle) m_cancel = true; // a long Browse ends at the next headerStep() or bodyStep()
+    xSemaphoreGive(m_reqMutex);
+    if(xTaskGetCurrentTaskHandle() == m_task) return false; // called from a callback, the task ends after this step
+    uint32_t t = millis();
+    while(m_task && millis() - t < waitMs) vTaskDelay(10);
+    if(m_task) {log_e("the task has not stopped within %lums", (long unsigned int)waitMs); return false;}
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::taskFunc(void* arg){
+    DLNA_Client* d = (DLNA_Client*)arg;
+    d->taskLoop();
+    d->m_task = NULL;
+    vTaskDelete(NULL);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::taskLoop(){ // the callbacks are called from here, with m_mutex taken
+    while(!m_taskStop){
+        if(xSemaphoreTakeRecursive(m_mutex, pdMS_TO_TICKS(10)) != pdTRUE) continue; // the application holds lock(), stopTask() is seen anyway
+        loop();
+        bool idle = m_state == IDLE && !m_reqHandle;
+        xSemaphoreGiveRecursive(m_mutex);
+        vTaskDelay(idle ? pdMS_TO_TICKS(10) : 1); // the application gets the mutex between two steps
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::request(uint8_t type, uint8_t srvNr, uint16_t startingIndex, uint16_t maxCount, char* objectId, char* criteria){ // the strings are taken over
+    uint32_t handle = 0;
+    if((type != REQ_SEEK && !objectId) || (type == REQ_SEARCH && !criteria)) log_e("oom");
+    else{
+        xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+        uint8_t i = 0;
+        while(i < DLNA_QUEUE_LEN && m_req[i].handle) i++;
+        if(i < DLNA_QUEUE_LEN){
+            if(++m_nextHandle == 0) m_nextHandle = 1;
+            request_t& r = m_req[i];
+            handle = r.handle = m_nextHandle;
+            r.type = type;
+            r.state = RQ_QUEUED;
+            r.cancel = false;
+            r.srvNr = srvNr;
+            r.startingIndex = startingIndex;
+            r.maxCount = maxCount;
+            r.objectId = objectId;
+            r.criteria = criteria;
+        }
+        xSemaphoreGive(m_reqMutex);
+        if(!handle) log_e("request queue is full");
+    }
+    if(handle) return handle;
+    if(objectId) free(objectId);
+    if(criteria) free(criteria);
+    return 0;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::requestSeek(uint8_t mx, uint8_t expectedServers){
+    return request(REQ_SEEK, mx, expectedServers, 0, NULL, NULL);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::requestBrowse(uint8_t srvNr, const char* objectId, uint16_t startingIndex, uint16_t maxCount){
+    if(!objectId) {log_e("objectId is NULL"); return 0;}
+    return request(REQ_BROWSE, srvNr, startingIndex, maxCount, x_ps_strdup(objectId), NULL);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::requestBrowseAll(uint8_t srvNr, const char* objectId, uint16_t pageSize){
+    if(!objectId) {log_e("objectId is NULL"); return 0;}
+    return request(REQ_BROWSE_ALL, srvNr, 0, pageSize, x_ps_strdup(objectId), NULL);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+uint32_t DLNA_Client::requestSearch(uint8_t srvNr, const char* containerId, const char* searchCriteria, uint16_t startingIndex, uint16_t maxCount){
+    if(!containerId || !searchCriteria) {log_e("containerId or searchCriteria is NULL"); return 0;}
+    return request(REQ_SEARCH, srvNr, startingIndex, maxCount, x_ps_strdup(containerId), x_ps_strdup(searchCriteria));
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::cancelRequest(uint32_t handle){ // false if the request has already finished
+    bool found = false;
+    xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+    if(handle && handle == m_reqHandle) {m_cancel = true; found = true;}
+    for(uint8_t i = 0; i < DLNA_QUEUE_LEN && !found; i++){
+        if(m_req[i].handle == handle && handle) found = requestCancel(i);
+    }
+    xSemaphoreGive(m_reqMutex);
+    return found;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::cancelAllRequests(){
+    xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+    if(m_reqHandle) m_cancel = true;
+    for(uint8_t i = 0; i < DLNA_QUEUE_LEN; i++){
+        if(m_req[i].handle) requestCancel(i);
+    }
+    xSemaphoreGive(m_reqMutex);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::requestCancel(uint8_t i){ // m_reqMutex is taken, a slot that loop() works with is only marked
+    request_t& r = m_req[i];
+    if(r.state != RQ_QUEUED) {r.cancel = true; return true;}
+    postResult(r.handle, -6);
+    if(r.objectId) {free(r.objectId); r.objectId = NULL;}
+    if(r.criteria) {free(r.criteria); r.criteria = NULL;}
+    r.handle = 0;
+    return true;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::requestRelease(uint8_t i, uint32_t running){ // the slot is free, running becomes m_reqHandle at the same time
+    request_t& r = m_req[i];
+    if(r.state == RQ_SENT) r.client.stop();
+    if(r.objectId) {free(r.objectId); r.objectId = NULL;}
+    if(r.criteria) {free(r.criteria); r.criteria = NULL;}
+    xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+    r.handle = 0;
+    m_reqHandle = running;
+    m_cancel = running && r.cancel; // cancelRequest() after requestStart() took the slot
+    xSemaphoreGive(m_reqMutex);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::requestStart(){ // called by loop() while IDLE, the oldest request becomes the running one
+    while(true){
+        int8_t n = -1;
+        xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+        for(uint8_t i = 0; i < DLNA_QUEUE_LEN; i++){
+            if(!m_req[i].handle) continue;
+            if(n < 0 || (int32_t)(m_req[i].handle - m_req[n].handle) < 0) n = i;
+        }
+        bool cancel = n >= 0 && m_req[n].cancel;
+        if(n >= 0) m_req[n].state = (m_req[n].state == RQ_SENT) ? RQ_SENT : RQ_BUSY; // the application keeps its hands off
+        xSemaphoreGive(m_reqMutex);
+        if(n < 0) return;
+        request_t& r = m_req[n];
+        if(cancel) {postResult(r.handle, -6); requestRelease(n, 0); continue;}
+
+        if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;}
+        if(r.state == RQ_SENT && r.filter != m_filter) {r.client.stop(); r.state = RQ_BUSY;} // setBrowseFilter() since it was sent
+        if(r.state == RQ_SENT){ // sent ahead by requestSendAhead(), the Browse takes the response like a prefetched page
+            m_prefetch = r.client;
+            m_prefetchReused = r.reused;
+            m_prefetchStart = r.startingIndex;
+            m_prefetchActive = true;
+            r.client = WiFiClient();
+            r.state = RQ_BUSY;
+        }
+        int8_t res = -1;
+        m_reqDone = false;
+        m_reqType = r.type;
+        switch(r.type){
+            case REQ_SEEK:       res = seekServer(r.srvNr, r.startingIndex) ? 0 : -1; break;
+            case REQ_BROWSE:     res = browseServer(r.srvNr, r.objectId, r.startingIndex, r.maxCount); break;
+            case REQ_BROWSE_ALL: res = browseServerAll(r.srvNr, r.objectId, r.maxCount); break;
+            case REQ_SEARCH:     res = searchServer(r.srvNr, r.objectId, r.criteria, r.startingIndex, r.maxCount); break;
+        }
+        if(res < 0){
+            if(m_prefetchActive) {m_prefetch.stop(); m_prefetchActive = false;}
+            postResult(r.handle, res);
+            requestRelease(n, 0);
+            continue;
+        }
+        requestRelease(n, r.handle);
+        if(r.type != REQ_SEEK) requestSendAhead();
+        return;
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::requestSendAhead(){ // queued Browse requests to other servers go out now, the servers work in parallel
+    while(true){
+        int8_t   n = -1;
+        uint8_t  sent = 0;
+        uint32_t busy = 1UL << (m_srvNr & 31); // one request per server
+        bool     seek = false;                 // the server numbers may change
+        xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+        for(uint8_t i = 0; i < DLNA_QUEUE_LEN; i++){
+            request_t& r = m_req[i];
+            if(!r.handle) continue;
+            if(r.type == REQ_SEEK) seek = true;
+            if(r.state == RQ_SENT) {busy |= 1UL << (r.srvNr & 31); sent++;}
+        }
+        for(uint8_t i = 0; i < DLNA_QUEUE_LEN && !seek && sent < DLNA_MAX_PARALLEL; i++){
+            request_t& r = m_req[i];
+            if(!r.handle || r.state != RQ_QUEUED || r.cancel || (r.type != REQ_BROWSE && r.type != REQ_BROWSE_ALL)) continue;
+            if(busy & (1UL << (r.srvNr & 31))) continue;
+            if((m_loopBudget || m_loopBytes) && (r.srvNr >= m_dlnaServer.size || !connIdle(r.srvNr))) continue; // setLoopBudget(), a connect would wait
+            if(n < 0 || (int32_t)(r.handle - m_req[n].handle) < 0) n = i;
+        }
+        if(n >= 0) m_req[n].state = RQ_BUSY;
+        xSemaphoreGive(m_reqMutex);
+        if(n < 0) return;
+        request_t& r = m_req[n];
+        r.metadata = false; // queued Browse requests list the children
+        r.filter = m_filter;
+        bool ok = r.srvNr < m_dlnaServer.size && strcmp(m_dlnaServer.controlURL[r.srvNr], "?") != 0 &&
+                  srvSend(r.client, r.reused, r.srvNr, r.objectId, r.startingIndex, r.maxCount, r.metadata, r.filter);
+        if(!ok) r.client.stop();
+        xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+        r.state = ok ? RQ_SENT : RQ_QUEUED;
+        xSemaphoreGive(m_reqMutex);
+        if(!ok) return; // it is sent again when it is its turn
+    }
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::requestFinish(){ // the running request is done
+    postResult(m_reqHandle, m_cancel ? -6 : m_reqDone ? 0 : -5);
+    xSemaphoreTake(m_reqMutex, portMAX_DELAY);
+    m_reqHandle = 0;
+    m_cancel = false;
+    xSemaphoreGive(m_reqMutex);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::postResult(uint32_t handle, int8_t result){
+    dlnaResult_t r = {handle, result, 0, 0};
+    if(result == 0 && m_reqType == REQ_SEEK) r.numberReturned = m_dlnaServer.size;
+    else if(result == 0) {r.numberReturned = m_numberReturned; r.totalMatches = m_totalMatches;}
+    if(!m_resultQueue || xQueueSend(m_resultQueue, &r, 0) != pdTRUE) log_e("result queue is full, request %lu", (long unsigned int)handle);
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::getResult(dlnaResult_t& r, uint32_t waitMs){ // the next finished request, the items are read with lock(), getItem() ...
+    if(!m_resultQueue) return false;
+    return xQueueReceive(m_resultQueue, &r, waitMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(waitMs)) == pdTRUE;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool DLNA_Client::lock(uint32_t waitMs){ // the task waits until unlock(), a running Browse is finished first
+    if(!m_mutex) return true;
+    return xSemaphoreTakeRecursive(m_mutex, waitMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(waitMs)) == pdTRUE;
+}
+//------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+void DLNA_Client::unlock(){
+    if(m_mutex) xSemaphoreGiveRecursive(m_mutex);
 }
@@ -1,25 +1,62 @@
 // Created on: 30.11.2023
-// Updated on: 06.04.2025
+// Updated on: 17.10.2026
 
 
 #pragma once
 
 #include <WiFi.h>
+#include <Preferences.h>
+#include <FS.h>
+#include <LittleFS.h>
 #include <vector>
+#include "lwip/sockets.h"
 
 #define SSDP_MULTICAST_IP         239, 255, 255, 250
-#define SSDP_LOCAL_PORT           8888
+#define SSDP_LOCAL_PORT           0         // M-SEARCH from a free port, setSsdpPort() for a fixed one (firewall)
 #define SSDP_MULTICAST_PORT       1900
-#define SEEK_TIMEOUT              8000
+#define SEEK_TIMEOUT              8000      // upper limit of the search window
+#define SSDP_MX                   3         // seconds, max. response delay requested from the servers (1...5)
+#define SSDP_RETRANSMITS          3         // number of M-SEARCH packets per search
+#define SSDP_RETRANSMIT_INTERVAL  100       // ms between two M-SEARCH packets
+#define SSDP_GRACE_TIME           500       // ms added to MX for network latency
+#define SSDP_DEFAULT_MAX_AGE      1800      // seconds, if the server sends no CACHE-CONTROL
+#define DLNA_MAX_SERVERS          32        // max. 32, see m_verified
+#define VERIFY_TIMEOUT            1000      // ms, cached servers must answer the unicast M-SEARCH within this time
+#define DLNA_CACHE_NAMESPACE      "dlna"    // NVS namespace of the server cache
 #define READ_TIMEOUT              2500
 #define CONNECT_TIMEOUT           6000
 #define AVAIL_TIMEOUT             2000
+#define DLNA_MAX_FETCH            4         // descriptions read at the same time, each needs a socket
+#define FETCH_ATTEMPTS            3
+#define STRING_POOL_SIZE          4096      // initial size of the string pool of the browse result
+#define DLNA_MAX_CONN             2         // idle keep-alive connections, each needs a socket
+#define KEEP_ALIVE_IDLE           10000     // ms, an idle connection older than this is not reused
+#define RX_BUF_SIZE               4096      // receive ring buffer of the Browse response, power of 2
+#define BROWSE_CACHE_SIZE         65536     // default byte budget of the browse cache, see enableBrowseCache()
+#define BROWSE_CACHE_TRUST        2000      // ms, a SystemUpdateID younger than this is not asked again
+#define CRAWL_PAGE                50        // items per Browse request of the crawler
+#define CRAWL_INTERVAL            250       // ms between two requests of the crawler, leaves the network to the audio stream
+#define CRAWL_MAGIC               0x44434C31 // "1LCD", format of crawl.dat
+#define CRAWL_ATTEMPTS            3         // a container that fails this often is skipped
+#define INDEX_KEY_LEN             12        // bytes of the lowercase title in the sorted index
+#define INDEX_SORT_RUN            1024      // index entries sorted in RAM at once
+#define INDEX_STEP                64        // records or index entries per loop() call while the index is built
+#define CBOR_PREFIXES             16        // URL prefixes cborContent() remembers
+#define SOAP_MAX_ARGS             8         // segments of the action arguments, see srvSoap()
+#define DLNA_TASK_STACK           8192      // bytes, see startTask()
+#define DLNA_TASK_PRIORITY        2
+#define DLNA_TASK_STOP_WAIT       10000     // ms, stopTask() waits for the running step
+#define DLNA_QUEUE_LEN            8         // requests and results waiting, see requestBrowse()
+#define DLNA_MAX_PARALLEL         2         // queued Browse requests sent ahead to other servers, each needs a socket
+#define HTTP_LENGTH_UNKNOWN       0xFFFFFFFF // no Content-Length, the body ends when the server closes the connection
 
 extern __attribute__((weak)) void dlna_info(const char *);
 extern __attribute__((weak)) void dlna_server(uint8_t serverId, const char* IP_addr, uint16_t port, const char* friendlyName, const char* controlURL);
 extern __attribute__((weak)) void dlna_seekReady(uint8_t numberOfServer);
-extern __attribute__((weak)) void dlna_browseResult(const char* objectId, const char* parentId, uint16_t childCount, const char* title, bool isAudio, uint32_t itemSize, const char* duration, const char* itemURL);
+extern __attribute__((weak)) void dlna_serverLost(uint8_t serverId, const char* IP_addr, uint16_t port, const char* friendlyName); // serverIds above serverId move down by one
+extern __attribute__((weak)) void dlna_browseResult(const char* objectId, const char* parentId, uint16_t childCount, const char* title, bool isAudio, uint32_t itemSize, const char* duration, const char* itemURL); // strings valid during the call, afterwards use getItem()
 extern __attribute__((weak)) void dlna_browseReady(uint16_t numberReturned, uint16_t totalMatches);
+extern __attribute__((weak)) void dlna_crawlReady(uint32_t numberOfTracks);
 
 class DLNA_Client{
 
@@ -33,12 +70,36 @@ public:
         std::vector<char*>     controlURL;
         std::vector<uint16_t>  presentationPort;
         std::vector<char*>     presentationURL;
+        std::vector<char*>     udn;              // unique device name from USN, "ip:port" if not given
+        std::vector<uint32_t>  expires;          // millis() at which the entry is outdated (CACHE-CONTROL: max-age)
     }dlnaServer_t;
 private:
     dlnaServer_t m_dlnaServer = {};
 
 public:
-    typedef struct srvContent {
+    typedef struct _serverInfo {             // view of one server, valid until the server table changes
+        const char* ip;
+        uint16_t    port;
+        const char* friendlyName;
+        const char* controlURL;
+        const char* location;
+        const char* presentationURL;
+        uint16_t    presentationPort;
+        const char* udn;
+    }serverInfo_t;
+
+    typedef struct _contentItem {            // view of one browse result entry, valid until the next browse
+        const char* objectId;
+        const char* parentId;
+        const char* title;
+        const char* duration;
+        const char* itemURL;
+        uint32_t    itemSize;
+        uint16_t    childCount;
+        bool        isAudio;
+    }contentItem_t;
+
+    typedef struct srvContent {              // copy of the result, see getBrowseResult()
         uint16_t size = 0;
         std::vector<char*>     objectId;
         std::vector<char*>     parentId;
@@ -49,62 +110,558 @@ public:
         std::vector<char*>     title;
         std::vector<int16_t>   childCount;
     }srvContent_t;
+
+    class itemRange {                        // for(auto item : dlna.browseItems()) {...}, walks the records, no allocation
+    public:
+        class iterator {
+        public:
+            iterator(const DLNA_Client* c, uint16_t i) : m_c(c), m_i(i) {}
+            contentItem_t operator*() const {return m_c->getItem(m_i);}
+            iterator& operator++() {m_i++; return *this;}
+            bool operator!=(const iterator& other) const {return m_i != other.m_i;}
+        private:
+            const DLNA_Client* m_c;
+            uint16_t m_i;
+        };
+        itemRange(const DLNA_Client* c, uint16_t first = 0, uint16_t count = 0xFFFF) : m_c(c), m_first(first) {
+            m_end = (uint32_t)first + count < c->m_recordCount ? first + count : c->m_recordCount;
+            if(m_first > m_end) m_first = m_end;
+        }
+        iterator begin() const {return iterator(m_c, m_first);}
+        iterator end() const {return iterator(m_c, m_end);}
+        uint16_t size() const {return m_end - m_first;}
+        uint16_t first() const {return m_first;}                                     // index for getItem()
+        contentItem_t operator[](uint16_t i) const {return m_c->getItem(m_first + i);}
+    private:
+        const DLNA_Client* m_c;
+        uint16_t m_first;
+        uint16_t m_end;
+    };
+
+    typedef struct _dlnaResult {             // a finished request, see getResult()
+        uint32_t   handle;                   // as returned by requestBrowse() ...
+        int8_t     result;                   // 0: done, < 0: error code of browseServer() ..., -5: failed, -6: cancelled
+        uint16_t   numberReturned;           // requestSeek(): number of servers
+        uint16_t   totalMatches;
+    }dlnaResult_t;
+
+    class Listener {                         // per instance instead of the weak dlna_xxx() functions, see setListener()
+    public:
+        virtual ~Listener() {}
+        virtual void onInfo(const char* /*info*/) {}
+        virtual void onServer(uint8_t /*serverId*/, const serverInfo_t& /*server*/) {}
+        virtual void onSeekReady(uint8_t /*numberOfServer*/) {}
+        virtual void onServerLost(uint8_t /*serverId*/, const serverInfo_t& /*server*/) {} // serverIds above serverId move down by one
+        virtual void onBrowseItems(const itemRange& /*items*/) {}  // stored entries, one batch per page or per batchSize entries
+        virtual void onBrowseItem(const contentItem_t& /*item*/) {} // entry beyond the memory limit, not stored, valid during the call
+        virtual void onBrowseReady(uint16_t /*numberReturned*/, uint16_t /*totalMatches*/) {}
+        virtual void onCrawlReady(uint32_t /*numberOfTracks*/) {}
+    };
 private:
-    srvContent_t m_srvContent = {};
+    typedef struct _itemRecord {             // stored entry, the strings are offsets into m_pool
+        uint32_t   objectId;
+        uint32_t   parentId;
+        uint32_t   title;
+        uint32_t   duration;
+        uint32_t   itemURL;
+        uint32_t   itemSize;
+        uint16_t   childCount;
+        bool       isAudio;
+    }itemRecord_t;
+
+    typedef struct _request {                // context of a queued request, see requestBrowse()
+        uint32_t   handle;                   // 0: free slot
+        uint8_t    type;                     // REQ_SEEK ...
+        uint8_t    state;                    // RQ_QUEUED ...
+        bool       cancel;                   // cancelRequest() while loop() works with the slot
+        uint8_t    srvNr;                    // REQ_SEEK: mx
+        uint16_t   startingIndex;            // REQ_SEEK: expectedServers
+        uint16_t   maxCount;                 // REQ_BROWSE_ALL: pageSize
+        char*      objectId;                 // x_ps_strdup
+        char*      criteria;
+        WiFiClient client;                   // RQ_SENT: the response arrives here
+        bool       reused;
+        bool       metadata;                 // RQ_SENT: BrowseFlag and Filter of the request on the way
+        uint16_t   filter;
+    }request_t;
+    enum {REQ_SEEK, REQ_BROWSE, REQ_BROWSE_ALL, REQ_SEARCH};
+    enum {RQ_QUEUED, RQ_BUSY, RQ_SENT};      // RQ_BUSY: loop() works with the slot, the application doesn't touch it
+
+    itemRecord_t* m_records = NULL;          // contiguous, in the order of the response
+    uint16_t      m_recordCount = 0;
+    uint16_t      m_recordSize = 0;
+    char*         m_pool = NULL;             // the strings of all records, zero terminated one after the other
+    uint32_t      m_poolLen = 0;
+    uint32_t      m_poolSize = 0;
+    bool          m_storeFull = false;       // setMemoryLimit(), items that did not fit went to dlna_browseResult() only
+    uint16_t      m_storeSkipped = 0;
+    Listener*     m_listener = NULL;         // setListener()
+    uint16_t      m_batchSize = 0;
+    uint16_t      m_batchFirst = 0;          // first record not yet given to onBrowseItems()
+
+private:
+    typedef struct _xmlTok {                 // streaming XML tokenizer, fed byte by byte by xmlParse()
+        uint8_t    type = 0;                 // XML_DESC, XML_SOAP, XML_DIDL: which handler gets the events
+        uint8_t    state = 0;
+        bool       endTag = false;
+        bool       emptyTag = false;
+        char       elem[40];                 // current element, e.g. "dc:title"
+        char       name[40];                 // name being read (element or attribute)
+        uint8_t    nameLen = 0;
+        char       quote = 0;
+        char       ent[12];                  // entity being read, e.g. "amp"
+        uint8_t    entLen = 0;
+        uint8_t    entRet = 0;               // state after the entity
+        uint8_t    match = 0;                // progress of "-->" or "]]>"
+        char*      sink = NULL;              // text or attribute value goes here (set by the handler)
+        uint16_t   sinkLen = 0;
+        uint16_t   sinkSize = 0;
+        bool       cut = false;              // the value did not fit into the sink, valid until the next event
+        char*      text = NULL;              // sink of the element text while attributes are read
+        uint16_t   textSize = 0;
+        struct _xmlTok* pipe = NULL;         // decoded text goes into this tokenizer (DIDL-Lite inside <Result>)
+        void*      ctx = NULL;
+    }xmlTok_t;
+    enum {XML_DESC, XML_SOAP, XML_DIDL};
+    enum {XML_START, XML_ATTR, XML_ATTR_END, XML_END};
+
+    typedef struct _didlItem {               // <item> or <container> while it is parsed
+        bool       isItem;
+        char       objectId[256];
+        char       parentId[256];
+        char       title[192];
+        char       itemURL[384];
+        char       duration[24];
+        char       upnpClass[64];
+        char       childCount[8];
+        char       itemSize[16];
+        bool       idCut;                    // objectId or parentId did not fit, the item is skipped
+        bool       urlCut;                   // a <res> URL did not fit
+    }didlItem_t;
+    didlItem_t  m_item;
+    xmlTok_t    m_soapTok;                   // SOAP envelope of the Browse response
+    xmlTok_t    m_didlTok;                   // DIDL-Lite inside <Result>
+    char        m_soapVal[16];               // NumberReturned, TotalMatches, UpdateID
+    uint32_t    m_updateId = 0;              // UpdateID of the Browse response, Id of GetSystemUpdateID
+    bool        m_updateIdSeen = false;
+
+    typedef struct _httpBody {               // framing of a HTTP/1.1 response body, see bodyDecode()
+        uint8_t    state = 0;                // BODY_SIZE ... BODY_DONE
+        bool       chunked = false;
+        uint32_t   remaining = 0;            // bytes left in the body (Content-Length) or in the current chunk
+        uint8_t    lineLen = 0;              // trailer line, BODY_SIZE: 1 if a digit has come
+        uint32_t   surplus = 0;              // received bytes behind the end of the body
+    }httpBody_t;
+    enum {BODY_SIZE, BODY_EXT, BODY_DATA, BODY_DATA_END, BODY_TRAILER, BODY_DONE, BODY_ERROR};
+    httpBody_t  m_body;                      // Browse response
+
+    typedef struct _descFetch {              // one description download in GET_SERVER_ITEMS
+        WiFiClient client;
+        int        fd = -1;                  // socket while connecting
+        uint8_t    srvNr = 0;
+        uint8_t    state = 0;                // FETCH_IDLE, FETCH_CONNECT, FETCH_RECEIVE
+        uint8_t    attempt = 0;
+        uint32_t   start = 0;                // first attempt
+        uint32_t   timeStamp = 0;            // current step
+        char       line[128];                // response header line
+        uint8_t    lineLen = 0;
+        bool       headerDone = false;
+        bool       statusOk = false;
+        bool       chunked = false;
+        bool       keepAlive = true;
+        uint32_t   contentLength = HTTP_LENGTH_UNKNOWN;
+        httpBody_t body;
+        xmlTok_t   tok;
+        bool       cdService = false;        // inside the <service> of the ContentDirectory
+        char       serviceType[80];
+        char       friendlyName[96];
+        char       controlURL[128];
+        char       presentationURL[96];
+    }descFetch_t;
+    descFetch_t m_fetch[DLNA_MAX_FETCH];
+    uint8_t     m_fetchNext = 0;             // next server that needs its description
+    enum {FETCH_IDLE, FETCH_CONNECT, FETCH_RECEIVE};
+
+    typedef struct _httpConn {               // idle keep-alive connection, m_client takes it over for the next request
+        WiFiClient client;
+        char       ip[16];
+        uint16_t   port = 0;
+        uint32_t   lastUse = 0;
+    }httpConn_t;
+    httpConn_t  m_conn[DLNA_MAX_CONN];
+
+    typedef struct _cacheEntry {             // one Browse response, the items are stored as records, see addItem()
+        uint32_t   srvKey;                   // fnv1a of the server UDN
+        char*      objectId;
+        uint16_t   startingIndex;
+        uint16_t   maxCount;
+        uint16_t   filter;                   // m_filter of the request
+        uint16_t   numberReturned;
+        uint16_t   totalMatches;
+        uint32_t   systemUpdateId;           // of the server when the entry was read
+        uint32_t   updateId;                 // UpdateID of the Browse response
+        char*      data;
+        uint32_t   len;
+    }cacheEntry_t;
+    std::vector<cacheEntry_t> m_browseCache; // least recently used first
+
+    typedef struct _sysUpdate {              // last GetSystemUpdateID per server
+        uint32_t   srvKey;
+        uint32_t   id;
+        uint32_t   checked;                  // millis()
+        bool       supported;                // false: the server does not answer GetSystemUpdateID, its responses are not cached
+    }sysUpdate_t;
+    std::vector<sysUpdate_t> m_sysUpdate;
+
+    typedef struct _crawlState {             // the crawler, stored in <dir>/crawl.dat after each page
+        uint32_t   magic;
+        char       udn[80];                  // server
+        uint32_t   queuePos;                 // current container in queue.dat
+        uint32_t   queueLen;                 // valid bytes of queue.dat, objectIds of all containers found so far
+        uint32_t   itemsLen;                 // valid bytes of items.dat, the tracks
+        uint32_t   tracks;
+        uint16_t   startingIndex;            // next page of the current container
+        uint8_t    done;
+    }crawlState_t;
+    crawlState_t m_crawl;
+
+    typedef struct _indexEntry {             // title.idx, sorted by key
+        char       key[INDEX_KEY_LEN];       // lowercase title, zero padded
+        uint32_t   offset;                   // record in items.dat
+    }indexEntry_t;
+
+    enum {IDX_OFF, IDX_RUNS, IDX_MERGE};
+    typedef struct _indexBuild {             // title.idx is built in steps, see indexStep()
+        uint8_t       phase = IDX_OFF;
+        File          items;                 // IDX_RUNS: items.dat is read, sorted runs go to idx0.tmp
+        File          run;
+        indexEntry_t* buf = NULL;            // INDEX_SORT_RUN entries
+        char*         rec = NULL;
+        uint32_t      fill;
+        uint32_t      offset;                // next record in items.dat
+        uint32_t      n;                     // entries
+        File          a, b, out;             // IDX_MERGE: pairs of runs of src are merged into dst
+        const char*   src;
+        const char*   dst;
+        uint32_t      runLen;
+        uint32_t      lo, mid, hi, i, j;     // the current pair, [i, mid) and [j, hi) are left
+        indexEntry_t  x, y;
+    }indexBuild_t;
+    indexBuild_t m_idx;
+
+    typedef struct _printBuf {               // printContent(), cborContent() ...
+        _printBuf(Print& p) : out(p) {}
+        Print&     out;
+        char       buf[128];                 // pieces are collected here, one write per 128 bytes
+        uint8_t    len = 0;
+        size_t     total = 0;
+    }printBuf_t;
+
+    typedef struct _searchCaps {             // GetSearchCapabilities per server
+        uint32_t   srvKey;
+        char*      caps;                     // "" if the server can't search
+    }searchCaps_t;
+    std::vector<searchCaps_t> m_searchCaps;
+    char        m_searchCapsBuf[256];        // SearchCaps of the response
+    char*       m_searchCriteria = NULL;
 
 private:
     WiFiClient  m_client;
     WiFiUDP     m_udp;
+    WiFiUDP     m_udpNotify;
     uint8_t     m_state = IDLE;
     uint32_t    m_timeStamp = 0;
     uint16_t    m_numberReturned = 0;
     uint16_t    m_totalMatches = 0;
     char*       m_JSONstr = NULL;
 
-    std::vector<char*> m_content;
-
 public:
     DLNA_Client();
     ~DLNA_Client();
-    bool seekServer();
+    bool seekServer(uint8_t mx = SSDP_MX, uint8_t expectedServers = 0);
+    void addExpectedServer(const char* ip);
+    void clearExpectedServers();
+    bool enableNotifyListener(bool enable = true);
+    void setSsdpPort(uint16_t port = SSDP_LOCAL_PORT);
+    int8_t loadServerCache();
+    bool saveServerCache();
+    void clearServerCache();
     int8_t listServer();
     dlnaServer_t getServer();
+    serverInfo_t getServerInfo(uint8_t srvNr) const;
     srvContent_t getBrowseResult();
+    uint16_t getItemCount() const {return m_recordCount;}
+    contentItem_t getItem(uint16_t i) const;
+    itemRange browseItems() const {return itemRange(this);}
+    void setListener(Listener* listener, uint16_t batchSize = 0); // NULL: the weak dlna_xxx() functions again, batchSize 0: one batch per page
     int8_t browseServer(uint8_t srvNr, const char* objectId, const uint16_t startingIndex = 0, const uint16_t maxCount = 50);
+    int8_t browseServerAll(uint8_t srvNr, const char* objectId, const uint16_t pageSize = 50);
+    int8_t getObjectMetadata(uint8_t srvNr, const char* objectId);
+    int8_t searchServer(uint8_t srvNr, const char* containerId, const char* searchCriteria, const uint16_t startingIndex = 0, const uint16_t maxCount = 50);
+    const char* getSearchCapabilities(uint8_t srvNr);
+    bool startCrawl(uint8_t srvNr, fs::FS& fs = LittleFS, const char* dir = "/dlna");
+    void stopCrawl();
+    bool crawlActive() {return m_crawlActive;}
+    bool openIndex(fs::FS& fs = LittleFS, const char* dir = "/dlna");
+    uint32_t getIndexSize();
+    int32_t indexSearch(const char* titlePrefix, uint16_t maxCount = 50);
+    int32_t indexList(uint32_t startIndex, uint16_t maxCount = 50);
+    void setBrowseFilter(uint16_t filter = FILTER_MINIMAL);
+    void enableBrowseCache(uint32_t budget = BROWSE_CACHE_SIZE);
+    void setMemoryLimit(uint32_t bytes);
+    uint32_t getMemoryPeak(bool reset = false);
+    void clearBrowseCache();
     const char* stringifyContent();
     const char* stringifyServer();
+    size_t printContent(Print& out, uint16_t first = 0, uint16_t count = 0xFFFF);
+    size_t printServer(Print& out);
+    // CBOR: [item, ...], item = [objectId, parentId, childCount, title, isAudio, itemSize, durationMs|null, url]
+    // url = null | "text" | [prefixIdx, prefix, suffix] (first use of a prefix) | [prefixIdx, suffix]
+    size_t cborContent(Print& out, uint16_t first = 0, uint16_t count = 0xFFFF);
+    size_t cborContent(uint8_t* buf, size_t size, uint16_t first = 0, uint16_t count = 0xFFFF);
+    size_t cborServer(Print& out);
+    size_t cborServer(uint8_t* buf, size_t size);
     uint8_t getState();
     int16_t getTotalMatches(){if(m_state == IDLE) return m_totalMatches;    else return -1;}
     int8_t  getNrOfServers() {if(m_state == IDLE) return m_dlnaServer.size; else return -1;}
     void loop();
+    void setLoopBudget(uint32_t us, uint32_t bytes = 0); // loop() returns after us or bytes of the response, 0, 0: a Browse is done in one call
+    uint32_t getLoopMax(bool reset = false);              // longest loop() call in us
+    bool startTask(UBaseType_t priority = DLNA_TASK_PRIORITY, uint32_t stackSize = DLNA_TASK_STACK, BaseType_t core = tskNO_AFFINITY);
+    bool stopTask(uint32_t waitMs = DLNA_TASK_STOP_WAIT);
+    uint32_t requestSeek(uint8_t mx = SSDP_MX, uint8_t expectedServers = 0); // queued, handle of the request, 0: the queue is full
+    uint32_t requestBrowse(uint8_t srvNr, const char* objectId, uint16_t startingIndex = 0, uint16_t maxCount = 50);
+    uint32_t requestBrowseAll(uint8_t srvNr, const char* objectId, uint16_t pageSize = 50);
+    uint32_t requestSearch(uint8_t srvNr, const char* containerId, const char* searchCriteria, uint16_t startingIndex = 0, uint16_t maxCount = 50);
+    bool getResult(dlnaResult_t& r, uint32_t waitMs = 0);
+    bool cancelRequest(uint32_t handle);     // queued: removed, running: aborted, the result is -6
+    void cancelAllRequests();                // e.g. the user has left the folder
+    bool lock(uint32_t waitMs = portMAX_DELAY); // while the task runs: other calls, getItem() ... only between lock() and unlock()
+    void unlock();
 
-    enum {IDLE, SEEK_SERVER, GET_SERVER_ITEMS, READ_HTTP_HEADER, BROWSE_SERVER};
+    enum {IDLE, SEEK_SERVER, GET_SERVER_ITEMS, READ_HTTP_HEADER, BROWSE_SERVER, SEARCH_SERVER};
+    enum {FILTER_ALL = 0, FILTER_TITLE = 0x01, FILTER_CLASS = 0x02, FILTER_RES = 0x04, FILTER_RES_SIZE = 0x08, FILTER_RES_DURATION = 0x10,
+          FILTER_CHILD_COUNT = 0x20, FILTER_MINIMAL = 0x3F}; // Browse/Search <Filter>, FILTER_ALL: "*", FILTER_MINIMAL: what the parser reads
 private:
     void parseDlnaServer(uint16_t len);
-    bool getServerItems(uint8_t srvNr);
-    bool browseResult();
-    bool srvGet(uint8_t srvNr);
+    void parseNotify(uint16_t len);
+    int16_t registerServer(const char* msg);
+    void removeServer(uint8_t srvNr);
+    void checkServerExpiry();
+    int16_t findServer(const char* udn);
+    void rebuildServerIndex();
+    bool sendMSearch(const char* ip = NULL);
+    void finishVerify();
+    bool seekComplete();
+    bool getServerItems(descFetch_t& f);
+    void xmlInit(xmlTok_t& t, uint8_t type, void* ctx = NULL);
+    void xmlParse(xmlTok_t& t, const char* buf, uint32_t len);
+    void xmlPut(xmlTok_t& t, char c);
+    bool xmlPutCodePoint(xmlTok_t& t, const char* num);
+    void xmlEvent(xmlTok_t& t, uint8_t ev);
+    void descEvent(xmlTok_t& t, uint8_t ev);
+    void soapEvent(xmlTok_t& t, uint8_t ev);
+    void didlEvent(xmlTok_t& t, uint8_t ev);
+    void didlItemDone();
+    void addItem(const char* objectId, const char* parentId, uint16_t childCount, const char* title, bool isAudio, uint32_t itemSize,
+                 const char* duration, const char* itemURL);
+    bool browseCached();
+    bool cacheLookup(uint32_t sysId);
+    const char* searchCaps(uint8_t srvNr);
+    const char* searchCapsStore(uint8_t srvNr, bool ok);
+    bool searchCheck(const char* caps);
+    bool searchSupported(const char* caps, const char* criteria);
+    bool search();
+    bool searchSend(bool wait);
+    void crawlStep();
+    void crawlPageDone(bool res);
+    void crawlAbort();
+    void crawlItem(const char* objectId, const char* parentId, const char* title, bool isAudio, uint32_t itemSize, const char* duration, const char* itemURL);
+    bool crawlSave();
+    void crawlTruncate(const char* name, uint32_t len);
+    void indexStart();
+    void indexStep();
+    void indexRunStep();
+    void indexPass();
+    void indexPair();
+    void indexMergeStep();
+    void indexDone(bool ok);
+    void indexAbort();
+    bool indexRecord(File& items, uint32_t offset, const char* prefix = NULL);
+    void indexKey(char* key, const char* title);
+    const char* crawlPath(const char* name);
+    bool systemUpdateId(uint8_t srvNr, uint32_t& id);
+    int8_t systemUpdateIdKnown(uint8_t srvNr, uint32_t& id);
+    bool systemUpdateIdStore(uint8_t srvNr, bool ok, uint32_t& id);
+    int16_t cacheFind(uint32_t srvKey, const char* objectId, uint16_t startingIndex, uint16_t maxCount);
+    void cacheReplay(uint16_t idx);
+    void cacheInsert();
+    void cacheDrop(uint16_t idx);
+    void cacheDropServer(uint32_t srvKey);
+    void connRelease(bool ok, uint8_t srvNr);
+    int  tcpConnectStart(const char* ip, uint16_t port);
+    int8_t tcpConnectPoll(int fd);
+    bool fetchStart(descFetch_t& f, uint8_t srvNr);
+    void fetchPoll(descFetch_t& f);
+    void fetchDone(descFetch_t& f, bool ok);
+    void fetchAbort(descFetch_t& f);
+    bool fetchServerItems();
+    bool connOpen(WiFiClient& client, uint8_t srvNr, bool& reused);
+    bool connTake(WiFiClient& client, uint8_t srvNr);
+    bool connIdle(uint8_t srvNr);
+    void connPark(const char* ip, uint16_t port, WiFiClient& client);
     bool readHttpHeader();
+    bool headerStart();
+    int8_t headerStep(bool sliced);
     bool readContent();
-    bool srvPost(uint8_t srvNr, const char* objectId, const uint16_t startingIndex, const uint16_t maxCount);
+    bool statusOk(uint8_t srvNr);
+    void contentStart();
+    void contentEnd();
+    bool readBody();
+    void bodyStart();
+    int8_t bodyStep(bool sliced);
+    bool budgetUsed(uint32_t bytes);
+    void browseStep();
+    void browseCall();
+    int8_t callStep();
+    bool callSend();
+    void browseDone(bool res);
+    void browseAbort();
+    uint32_t rxFill(uint32_t maxLen);
+    void bodyInit(httpBody_t& b, bool chunked, uint32_t contentLength);
+    int32_t bodyDecode(httpBody_t& b, char* buf, int32_t len);
+    bool srvPost(uint8_t srvNr, const char* objectId, const uint16_t startingIndex, const uint16_t maxCount, bool metadata, uint16_t filter);
+    bool srvCall(uint8_t srvNr, const char* action, const char** args = NULL, uint8_t argc = 0);
+    bool srvSoap(WiFiClient& client, bool& reused, uint8_t srvNr, const char* action, const char** args, uint8_t argc, bool open = true);
+    bool sendAll(WiFiClient& client, const struct iovec* segments, uint8_t n);
+    char* xmlEscape(const char* str);
+    bool srvSend(WiFiClient& client, bool& reused, uint8_t srvNr, const char* objectId, const uint16_t startingIndex, const uint16_t maxCount,
+                 bool metadata, uint16_t filter, bool open = true);
+    int8_t srvWait(uint8_t srvNr, bool reused);
+    const char* filterString(uint16_t filter);
+    bool prefetchPage(uint16_t startingIndex);
+    void prefetchNext();
+    void bufPut(printBuf_t& j, const char* str, uint32_t len = UINT32_MAX);
+    void jsonStr(printBuf_t& j, const char* str);
+    void bufFlush(printBuf_t& j);
+    void cbInfo(const char* info);
+    void cbServer(uint8_t srvNr);
+    void cbServerLost(uint8_t srvNr);
+    void cbSeekReady();
+    void cbItems();
+    void cbBrowseReady();
+    void cbCrawlReady();
+    static void taskFunc(void* arg);
+    void taskLoop();
+    uint32_t request(uint8_t type, uint8_t srvNr, uint16_t startingIndex, uint16_t maxCount, char* objectId, char* criteria);
+    bool requestCancel(uint8_t i);
+    void requestStart();
+    void requestSendAhead();
+    void requestRelease(uint8_t i, uint32_t running);
+    void requestFinish();
+    void postResult(uint32_t handle, int8_t result);
+    void cborHead(printBuf_t& j, uint8_t major, uint32_t val);
+    void cborText(printBuf_t& j, const char* str, uint32_t len = UINT32_MAX);
+    int32_t durationMs(const char* duration);
 
 
 
 private:
     bool        m_PSRAMfound = false;
     bool        m_chunked = false;
+    bool        m_keepAlive = false;            // the server keeps the connection open after the response
+    char*       m_rxBuf = NULL;                 // receive ring buffer, RX_BUF_SIZE
+    uint32_t    m_rxHead = 0;                   // write index, free running
+    uint32_t    m_rxTail = 0;                   // read index, free running
+    char        m_hdrLine[128];                 // headerStep(), the line read so far
+    uint8_t     m_hdrLen = 0;
+    bool        m_hdrCtSeen = false;            // a usable content-type has come
     char*       m_chbuf = NULL;
-    char        m_objectId[60];
+    char*       m_objectId = NULL;
     uint8_t     m_srvNr = 0;
     uint16_t    m_chbufSize = 0;
-    uint32_t    m_contentlength = 0;
+    uint32_t    m_contentlength = HTTP_LENGTH_UNKNOWN;
+    uint16_t    m_httpStatus = 0;               // of the last response header, 200: OK
     uint16_t    m_startingIndex = 0;
     uint16_t    m_maxCount = 100;
+    uint16_t    m_filter = FILTER_MINIMAL;      // properties requested by Browse and Search, see setBrowseFilter()
+    char        m_filterStr[96];
+    bool        m_metadata = false;             // getObjectMetadata(), BrowseMetadata instead of BrowseDirectChildren
+    bool        m_paged = false;                // browseServerAll(), walk the container up to TotalMatches
+    uint16_t    m_pageTotal = 0;                // TotalMatches of the last page
+    uint16_t    m_pageDelivered = 0;            // items of all pages so far
+    uint32_t    m_cacheBudget = 0;              // bytes, 0: browse cache disabled
+    uint32_t    m_memLimit = 0;                 // bytes of heap for buffers, result and cache, 0: no limit
+    uint32_t    m_memPeak = 0;
+    uint32_t    m_cacheBytes = 0;
+    char*       m_capture = NULL;               // records of the running Browse, for the browse cache
+    uint32_t    m_captureLen = 0;
+    uint32_t    m_captureSize = 0;
+    bool        m_captureOn = false;
+    uint32_t    m_captureSysId = 0;
+    TaskHandle_t      m_task = NULL;            // startTask(), loop() runs here
+    QueueHandle_t     m_resultQueue = NULL;
+    SemaphoreHandle_t m_mutex = NULL;           // held by the task while it works, lock()
+    SemaphoreHandle_t m_reqMutex = NULL;        // m_req, m_reqHandle, held only for a moment
+    volatile bool     m_taskStop = false;
+    volatile bool     m_cancel = false;         // the running request is aborted
+    request_t   m_req[DLNA_QUEUE_LEN];
+    uint32_t    m_nextHandle = 0;
+    uint32_t    m_reqHandle = 0;                // running request, 0: none
+    uint8_t     m_reqType = REQ_SEEK;
+    bool        m_reqDone = false;              // dlna_browseReady() or dlna_seekReady() has come
+    enum {STEP_START, STEP_CONNECT, STEP_SEND, STEP_WAIT, STEP_HEADER, STEP_BODY};
+    enum {CALL_BROWSE, CALL_SEARCH, CALL_CRAWL, CALL_SYSID, CALL_CAPS};
+    uint32_t    m_loopBudget = 0;               // us per loop() call, setLoopBudget()
+    uint32_t    m_loopBytes = 0;                // bytes of the response per loop() call
+    uint32_t    m_loopStart = 0;                // micros() at the begin of loop()
+    uint32_t    m_loopMax = 0;                  // longest loop() call, us
+    uint8_t     m_step = STEP_START;            // where browseStep() goes on
+    uint8_t     m_stepAttempt = 0;
+    int         m_stepFd = -1;                  // STEP_CONNECT, non-blocking connect
+    bool        m_stepReused = false;
+    uint8_t     m_call = CALL_BROWSE;           // what callStep() asks the server
+    uint8_t     m_callSrv = 0;
+    bool        m_crawlActive = false;
+    bool        m_crawlRun = false;             // a page of the crawler is parsed, addItem() -> crawlItem()
+    bool        m_crawlPage = false;            // a page is on the way, crawlStep() goes on with it
+    char        m_crawlId[256];                 // container of the page, as long as didlItem_t::objectId
+    uint32_t    m_crawlIdLen = 0;               // bytes in queue.dat, with the terminating 0
+    uint16_t    m_crawlReturned = 0;            // NumberReturned and TotalMatches of the page
+    uint16_t    m_crawlTotal = 0;
+    crawlState_t m_crawlSaved;                  // before the page, back to it if the page fails
+    fs::FS*     m_crawlFS = NULL;
+    char        m_crawlDir[32];
+    char        m_crawlPath[48];
+    uint32_t    m_crawlLast = 0;
+    uint8_t     m_crawlFails = 0;               // failed requests for the current page
+    File        m_crawlItems;                   // open while a page is parsed
+    File        m_crawlQueue;
+    WiFiClient  m_prefetch;                     // the request of the next page is on the way here
+    bool        m_prefetchActive = false;
+    bool        m_prefetchReused = false;
+    uint16_t    m_prefetchStart = 0;
+    uint8_t     m_mx = SSDP_MX;
+    uint16_t    m_ssdpPort = SSDP_LOCAL_PORT;   // setSsdpPort()
+    uint8_t     m_ssdpSent = 0;             // M-SEARCH packets sent so far
+    uint8_t     m_expectedServers = 0;      // finish the search early if this number of servers answered, 0 = wait for MX
+    uint32_t    m_ssdpLastTx = 0;
+    uint32_t    m_seekWindow = SEEK_TIMEOUT;
+    std::vector<char*> m_expectedIP;        // finish the search early if all of these servers answered
+    bool        m_notifyEnabled = false;
+    bool        m_seekActive = false;           // GET_SERVER_ITEMS was started by seekServer(), call dlna_seekReady() at the end
+    bool        m_resolvePending = false;       // a server announced by NOTIFY is waiting for its description
+    uint32_t    m_expiryCheck = 0;
+    uint8_t     m_srvIndex[DLNA_MAX_SERVERS * 2]; // open addressing hash table udn -> server index, 0xFF = empty
+    bool        m_cacheEnabled = false;         // loadServerCache() was called, save the server table after each seek
+    bool        m_verifyActive = false;         // cached servers are checked by unicast M-SEARCH
+    uint32_t    m_verified = 0;                 // bit n: server n answered the unicast M-SEARCH
+    uint32_t    m_probing = 0;                  // bit n: server n did not answer, its description is read again (GET)
 
     //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
     void vector_clear_and_shrink(std::vector<char*>&vec){
         uint size = vec.size();
-        for (int32_t i = 0; i < size; i++) {
+        for (uint i = 0; i < size; i++) {
             if(vec[i]){
                 free(vec[i]);
                 vec[i] = NULL;
@@ -114,6 +671,31 @@ private:
         vec.shrink_to_fit();
     }
     //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    void chbuf_alloc(){
+        if(m_chbufSize == 4 * 4096) return; // already done
+        if(m_chbuf) {free(m_chbuf); m_chbuf = NULL;}
+        if(m_PSRAMfound == false) {
+            m_chbuf = (char*)malloc(512);
+            m_chbufSize = 512;
+        }
+        else {
+            m_chbuf = (char*)ps_malloc(4 * 4096);
+            m_chbufSize = 4 *4096;
+        }
+        mem_grow(0, 0);
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    uint32_t mem_used(){ // heap held by the client, without the server table and sockets
+        return m_chbufSize + (m_rxBuf ? RX_BUF_SIZE : 0) + m_recordSize * sizeof(itemRecord_t) + m_poolSize + m_captureSize + m_cacheBytes;
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    bool mem_grow(uint32_t oldSize, uint32_t newSize){ // false if a buffer of oldSize may not become newSize bytes
+        uint32_t used = mem_used() - oldSize + newSize;
+        if(m_memLimit && newSize > oldSize && used > m_memLimit) return false;
+        if(used > m_memPeak) m_memPeak = used;
+        return true;
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
     void dlnaServer_clear_and_shrink(){
         m_dlnaServer.size = 0;
         vector_clear_and_shrink(m_dlnaServer.ip);
@@ -125,28 +707,60 @@ private:
         m_dlnaServer.presentationPort.clear();
         m_dlnaServer.presentationPort.shrink_to_fit();
         vector_clear_and_shrink(m_dlnaServer.presentationURL);
+        vector_clear_and_shrink(m_dlnaServer.udn);
+        m_dlnaServer.expires.clear();
+        m_dlnaServer.expires.shrink_to_fit();
+        memset(m_srvIndex, 0xFF, sizeof(m_srvIndex));
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    void srvContent_clear(){ // for the next browse, records and pool keep their memory
+        m_recordCount = 0;
+        m_poolLen = 0;
+        m_storeFull = false;
+        m_storeSkipped = 0;
+        m_batchFirst = 0;
     }
     //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
     void srvContent_clear_and_shrink(){
-        m_srvContent.size = 0;
-        vector_clear_and_shrink(m_srvContent.objectId);
-        vector_clear_and_shrink(m_srvContent.parentId);
-        m_srvContent.isAudio.clear();
-        m_srvContent.isAudio.shrink_to_fit();
-        vector_clear_and_shrink(m_srvContent.itemURL);
-        m_srvContent.itemSize.clear();
-        m_srvContent.itemSize.shrink_to_fit();
-        vector_clear_and_shrink(m_srvContent.duration);
-        vector_clear_and_shrink(m_srvContent.title);
-        m_srvContent.childCount.clear();
-        m_srvContent.childCount.shrink_to_fit();
+        srvContent_clear();
+        if(m_records) {free(m_records); m_records = NULL;}
+        if(m_pool) {free(m_pool); m_pool = NULL;}
+        m_recordSize = 0;
+        m_poolSize = 0;
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    void srvContent_reserve(uint16_t n){
+        if(n <= m_recordSize) return;
+        if(!mem_grow(m_recordSize * sizeof(itemRecord_t), n * sizeof(itemRecord_t))) return;
+        itemRecord_t* r = (itemRecord_t*)x_ps_realloc((char*)m_records, n * sizeof(itemRecord_t));
+        m_records = r;
+        m_recordSize = r ? n : 0;
+        if(!r) m_recordCount = 0;
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    uint32_t pool_strdup(const char* str){ // offset of the copy in m_pool, the pool grows by doubling
+        uint32_t len = strlen(str) + 1;
+        if(m_poolLen + len > m_poolSize){
+            uint32_t size = m_poolSize ? m_poolSize * 2 : STRING_POOL_SIZE;
+            while(size < m_poolLen + len) size *= 2;
+            if(!mem_grow(m_poolSize, size)) size = m_poolLen + len; // as much as the limit allows
+            if(!mem_grow(m_poolSize, size)) return UINT32_MAX;     // the pool stays as it is
+            char* p = x_ps_realloc(m_pool, size);
+            m_pool = p;
+            m_poolSize = p ? size : 0;
+            if(!p) {m_poolLen = 0; m_recordCount = 0; return UINT32_MAX;}
+        }
+        uint32_t offs = m_poolLen;
+        memcpy(m_pool + offs, str, len);
+        m_poolLen += len;
+        return offs;
     }
     //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
     int32_t indexOf(const char* haystack, const char* needle, int32_t startIndex) {
         const char* p = haystack;
         for(; startIndex > 0; startIndex--)
             if(*p++ == '\0') return -1;
-        char* pos = strstr(p, needle);
+        const char* pos = strstr(p, needle);
         if(pos == nullptr) return -1;
         return pos - haystack;
     }
@@ -167,35 +781,45 @@ private:
         return (strncmp(p, searchString, slen) == 0);
     }
     //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
-    int replacestr(char *line, const char *search, const char *replace){  /* returns number of strings replaced.*/
-       int count;
-       char *sp; // start of pattern
-        //printf("replacestr(%s, %s, %s)\n", line, search, replace);
-        if ((sp = strstr(line, search)) == NULL) {
-           return(0);
-        }
-        count = 1;
-        int sLen = strlen(search);
-        int rLen = strlen(replace);
-        if (sLen > rLen) {
-           // move from right to left
-           char *src = sp + sLen;
-           char *dst = sp + rLen;
-           while((*dst = *src) != '\0') { dst++; src++; }
-        } else if (sLen < rLen) {
-           // move from left to right
-           int tLen = strlen(sp) - sLen;
-           char *stop = sp + rLen;
-           char *src = sp + sLen + tLen;
-           char *dst = sp + rLen + tLen;
-           while(dst >= stop) { *dst = *src; dst--; src--; }
+    uint32_t fnv1a(const char* str){ // 32 bit FNV-1a hash
+        uint32_t h = 2166136261UL;
+        while(*str){ h ^= (uint8_t)*str++; h *= 16777619UL; }
+        return h;
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    bool rx_alloc(){ // empty receive buffer for a new response
+        if(!m_rxBuf) {m_rxBuf = (char*)malloc(RX_BUF_SIZE); mem_grow(0, 0);} // internal RAM, this is the hot path
+        m_rxHead = m_rxTail = 0;
+        return m_rxBuf != NULL;
+    }
+    uint32_t rx_used(){return m_rxHead - m_rxTail;}
+    uint8_t  rx_get() {return m_rxBuf[m_rxTail++ & (RX_BUF_SIZE - 1)];}
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    int32_t body_want(const httpBody_t& b, int32_t n){ // don't read beyond a body of known length, the socket may be reused
+        if(!b.chunked && b.remaining < (uint32_t)n) return b.remaining;
+        return n;
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    bool ssdpField(const char* msg, const char* field, char* val, uint16_t valSize){ // copy the value of a SSDP header field, case insensitive
+        uint16_t fLen = strlen(field);
+        const char* p = msg;
+        while(p && *p){
+            if(strncasecmp(p, field, fLen) == 0 && p[fLen] == ':'){
+                p += fLen + 1;
+                while(*p == ' ') p++;
+                uint16_t i = 0;
+                while(*p && *p != '\r' && *p != '\n' && i < valSize - 1) val[i++] = *p++;
+                val[i] = '\0';
+                return true;
+            }
+            p = strchr(p, '\n');
+            if(p) p++;
         }
-        memcpy(sp, replace, rLen);
-        count += replacestr(sp + rLen, search, replace);
-        return(count);
+        val[0] = '\0';
+        return false;
     }
     //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
-    inline char* x_ps_malloc(uint16_t len) {
+    inline char* x_ps_malloc(uint32_t len) {
         char* ps_str = NULL;
         if(psramFound()){ps_str = (char*) ps_malloc(len);}
         else             {ps_str = (char*)    malloc(len);}
@@ -204,6 +828,14 @@ private:
         return ps_str;
     }
     //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
+    inline char* x_ps_realloc(char* ptr, uint32_t len) {
+        char* ps_str = NULL;
+        if(m_PSRAMfound){ps_str = (char*) ps_realloc(ptr, len);}
+        else            {ps_str = (char*)    realloc(ptr, len);}
+        if(!ps_str){log_e("oom"); free(ptr);}
+        return ps_str;
+    }
+    //——————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————————
     char* x_ps_strdup(const char* str){
         if(!str){log_e("given str is NULL");}
         char* ps_str = NULL;